@@ -0,0 +1,312 @@
+#include "CarConfig.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+const char* const IR_BUTTON_NAMES[IR_BUTTON_COUNT] = {
+  "stop", "forward", "backward", "left", "right", "headlight",
+  "brakelight", "indicator-left", "indicator-right", "hazard", "horn", "garage"
+};
+
+// Reflected CRC-32 (zlib, esptool); bitwise, the block is small
+uint32_t crc32(const uint8_t* data, size_t length) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+// ===== Byte Packing =====
+class Writer {
+ public:
+  explicit Writer(uint8_t* p) : p(p) {}
+  void u8(uint8_t value) { *p++ = value; }
+  void u16(uint16_t value) { u8(value); u8(value >> 8); }
+  void u32(uint32_t value) { u16(value); u16(value >> 16); }
+  void bytes(const void* data, size_t length) { memcpy(p, data, length); p += length; }
+
+  uint8_t* p;
+};
+
+// Once the payload runs out, which is where an older block ends, reads
+// leave the remaining fields at their defaults
+class Reader {
+ public:
+  Reader(const uint8_t* p, size_t remaining) : p(p), remaining(remaining) {}
+
+  void u8(uint8_t& value) {
+    if (take(1)) value = p[-1];
+  }
+  void u16(uint16_t& value) {
+    if (take(2)) value = p[-2] | (p[-1] << 8);
+  }
+  void u32(uint32_t& value) {
+    if (take(4)) value = p[-4] | (p[-3] << 8) | ((uint32_t)p[-2] << 16) | ((uint32_t)p[-1] << 24);
+  }
+  void bytes(void* data, size_t length) {
+    if (take(length)) memcpy(data, p - length, length);
+  }
+
+ private:
+  bool take(size_t length) {
+    if (remaining < length) {
+      remaining = 0;
+      return false;
+    }
+    p += length;
+    remaining -= length;
+    return true;
+  }
+
+  const uint8_t* p;
+  size_t remaining;
+};
+
+// ===== Text Parsing =====
+bool is(const char* text, size_t length, const char* literal) {
+  size_t n = strlen(literal);
+  return length == n && memcmp(text, literal, n) == 0;
+}
+
+// Decimal or 0x-prefixed hex, nothing else, no overflow
+bool parseNumber(const char* text, size_t length, uint32_t max, uint32_t& out) {
+  uint32_t base = 10;
+  if (length > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+    base = 16;
+    text += 2;
+    length -= 2;
+  }
+  if (length == 0) return false;
+
+  uint64_t value = 0;
+  for (size_t i = 0; i < length; i++) {
+    char c = text[i];
+    uint32_t digit;
+    if (c >= '0' && c <= '9') digit = c - '0';
+    else if (base == 16 && c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+    else if (base == 16 && c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+    else return false;
+    value = value * base + digit;
+    if (value > max) return false;
+  }
+  out = (uint32_t)value;
+  return true;
+}
+
+bool parseIp(const char* text, size_t length, uint8_t ip[4]) {
+  uint8_t parsed[4];
+  size_t start = 0;
+  for (int part = 0; part < 4; part++) {
+    size_t end = start;
+    while (end < length && text[end] != '.') end++;
+    uint32_t value;
+    if (!parseNumber(text + start, end - start, 255, value)) return false;
+    parsed[part] = value;
+    if (part < 3 && end == length) return false;
+    start = end + 1;
+  }
+  if (start != length + 1) return false;
+  memcpy(ip, parsed, 4);
+  return true;
+}
+
+bool setString(char* field, size_t fieldSize, const char* text, size_t length) {
+  if (length >= fieldSize || memchr(text, ',', length) || memchr(text, '\0', length)) return false;
+  memcpy(field, text, length);
+  memset(field + length, 0, fieldSize - length);
+  return true;
+}
+
+}  // namespace
+
+const char* configErrorName(ConfigError error) {
+  switch (error) {
+    case CONFIG_OK: return "ok";
+    case CONFIG_ERR_EMPTY: return "empty";
+    case CONFIG_ERR_VERSION: return "version";
+    case CONFIG_ERR_LENGTH: return "length";
+    case CONFIG_ERR_CRC: return "crc";
+    case CONFIG_ERR_RANGE: return "range";
+    case CONFIG_ERR_KEY: return "key";
+    case CONFIG_ERR_STORE: return "store";
+  }
+  return "unknown";
+}
+
+// ===== Validation =====
+ConfigError validateConfig(const CarConfig& c) {
+  bool ok =
+    c.pwmSpeed <= 1023 && c.turnSpeed <= 1023 &&
+    c.garageSpeed <= 100 && c.cruiseSpeed <= 100 &&
+    c.indicatorMs >= 20 && c.indicatorMs <= 5000 &&   // what a light pattern step can hold
+    c.hornMs >= 20 && c.hornMs <= 5000 &&
+    c.heartbeatMs >= 1000 && c.heartbeatMs <= 600000 &&
+    c.apChannel >= 1 && c.apChannel <= 13 &&
+    c.apIp[0] != 0;
+
+  size_t ssid = strnlen(c.apSsid, sizeof(c.apSsid));
+  size_t password = strnlen(c.apPassword, sizeof(c.apPassword));
+  ok = ok && ssid >= 1 && ssid <= CONFIG_SSID_SIZE;
+  // An open AP, or WPA2 with 8..63 characters
+  ok = ok && (password == 0 || (password >= 8 && password < CONFIG_PASSWORD_SIZE));
+  return ok ? CONFIG_OK : CONFIG_ERR_RANGE;
+}
+
+// ===== Binary Form =====
+void encodeConfig(const CarConfig& config, uint8_t* block) {
+  memset(block, 0, CONFIG_BLOCK_SIZE);
+
+  Writer payload(block + CONFIG_HEADER_SIZE);
+  payload.u16(config.pwmSpeed);
+  payload.u16(config.turnSpeed);
+  payload.u8(config.garageSpeed);
+  payload.u8(config.cruiseSpeed);
+  payload.u16(config.indicatorMs);
+  payload.u16(config.hornMs);
+  payload.u32(config.heartbeatMs);
+  for (uint32_t code : config.irCodes) payload.u32(code);
+  payload.bytes(config.apIp, 4);
+  payload.u8(config.apChannel);
+  payload.bytes(config.apSsid, CONFIG_SSID_SIZE);
+  payload.bytes(config.apPassword, CONFIG_PASSWORD_SIZE);
+
+  Writer header(block);
+  header.bytes(CONFIG_MAGIC, sizeof(CONFIG_MAGIC));
+  header.u8(CONFIG_VERSION);
+  header.u16(CONFIG_PAYLOAD_SIZE);
+  header.u16(0);
+  header.u32(crc32(block + CONFIG_HEADER_SIZE, CONFIG_PAYLOAD_SIZE));
+}
+
+ConfigError decodeConfig(const uint8_t* block, size_t length, CarConfig& config) {
+  if (length < CONFIG_HEADER_SIZE || memcmp(block, CONFIG_MAGIC, sizeof(CONFIG_MAGIC)) != 0) {
+    return CONFIG_ERR_EMPTY;
+  }
+  if (block[3] == 0 || block[3] > CONFIG_VERSION) return CONFIG_ERR_VERSION;
+
+  size_t payloadLength = block[4] | (block[5] << 8);
+  if (payloadLength > length - CONFIG_HEADER_SIZE) return CONFIG_ERR_LENGTH;
+
+  const uint8_t* payload = block + CONFIG_HEADER_SIZE;
+  uint32_t crc = block[8] | (block[9] << 8) | ((uint32_t)block[10] << 16) | ((uint32_t)block[11] << 24);
+  if (crc != crc32(payload, payloadLength)) return CONFIG_ERR_CRC;
+
+  CarConfig loaded = config;
+  Reader in(payload, payloadLength);
+  in.u16(loaded.pwmSpeed);
+  in.u16(loaded.turnSpeed);
+  in.u8(loaded.garageSpeed);
+  in.u8(loaded.cruiseSpeed);
+  in.u16(loaded.indicatorMs);
+  in.u16(loaded.hornMs);
+  in.u32(loaded.heartbeatMs);
+  for (uint32_t& code : loaded.irCodes) in.u32(code);
+  in.bytes(loaded.apIp, 4);
+  in.u8(loaded.apChannel);
+  in.bytes(loaded.apSsid, CONFIG_SSID_SIZE);
+  in.bytes(loaded.apPassword, CONFIG_PASSWORD_SIZE);
+
+  loaded.apSsid[CONFIG_SSID_SIZE] = '\0';
+  if (validateConfig(loaded) != CONFIG_OK) return CONFIG_ERR_RANGE;
+  config = loaded;
+  return CONFIG_OK;
+}
+
+// ===== Text Form =====
+ConfigError setConfigValue(CarConfig& config, const char* text, size_t length) {
+  const char* sep = (const char*)memchr(text, '=', length);
+  if (!sep) return CONFIG_ERR_KEY;
+
+  const char* key = text;
+  size_t keyLength = sep - text;
+  const char* value = sep + 1;
+  size_t valueLength = text + length - value;
+
+  CarConfig edited = config;
+  uint32_t number = 0;
+  bool parsed;
+
+  if (is(key, keyLength, "pwmSpeed")) {
+    parsed = parseNumber(value, valueLength, 0xFFFF, number);
+    edited.pwmSpeed = number;
+  } else if (is(key, keyLength, "turnSpeed")) {
+    parsed = parseNumber(value, valueLength, 0xFFFF, number);
+    edited.turnSpeed = number;
+  } else if (is(key, keyLength, "garageSpeed")) {
+    parsed = parseNumber(value, valueLength, 0xFF, number);
+    edited.garageSpeed = number;
+  } else if (is(key, keyLength, "cruiseSpeed")) {
+    parsed = parseNumber(value, valueLength, 0xFF, number);
+    edited.cruiseSpeed = number;
+  } else if (is(key, keyLength, "indicatorMs")) {
+    parsed = parseNumber(value, valueLength, 0xFFFF, number);
+    edited.indicatorMs = number;
+  } else if (is(key, keyLength, "hornMs")) {
+    parsed = parseNumber(value, valueLength, 0xFFFF, number);
+    edited.hornMs = number;
+  } else if (is(key, keyLength, "heartbeatMs")) {
+    parsed = parseNumber(value, valueLength, 0xFFFFFFFF, number);
+    edited.heartbeatMs = number;
+  } else if (is(key, keyLength, "apIp")) {
+    parsed = parseIp(value, valueLength, edited.apIp);
+  } else if (is(key, keyLength, "apChannel")) {
+    parsed = parseNumber(value, valueLength, 0xFF, number);
+    edited.apChannel = number;
+  } else if (is(key, keyLength, "apSsid")) {
+    parsed = setString(edited.apSsid, sizeof(edited.apSsid), value, valueLength);
+  } else if (is(key, keyLength, "apPassword")) {
+    parsed = setString(edited.apPassword, sizeof(edited.apPassword), value, valueLength);
+  } else if (keyLength > 3 && memcmp(key, "ir.", 3) == 0) {
+    int button = -1;
+    for (int i = 0; i < IR_BUTTON_COUNT; i++) {
+      if (is(key + 3, keyLength - 3, IR_BUTTON_NAMES[i])) button = i;
+    }
+    if (button < 0) return CONFIG_ERR_KEY;
+    parsed = parseNumber(value, valueLength, 0xFFFFFFFF, number);
+    edited.irCodes[button] = number;
+  } else {
+    return CONFIG_ERR_KEY;
+  }
+
+  if (!parsed || validateConfig(edited) != CONFIG_OK) return CONFIG_ERR_RANGE;
+  config = edited;
+  return CONFIG_OK;
+}
+
+int formatConfig(const CarConfig& c, char* text, size_t size) {
+  int n = snprintf(text, size,
+    "pwmSpeed=%u,turnSpeed=%u,garageSpeed=%u,cruiseSpeed=%u,"
+    "indicatorMs=%u,hornMs=%u,heartbeatMs=%lu,",
+    c.pwmSpeed, c.turnSpeed, c.garageSpeed, c.cruiseSpeed,
+    c.indicatorMs, c.hornMs, (unsigned long)c.heartbeatMs);
+
+  for (int i = 0; i < IR_BUTTON_COUNT; i++) {
+    if (n < 0 || (size_t)n >= size) return n;
+    n += snprintf(text + n, size - n, "ir.%s=0x%lX,", IR_BUTTON_NAMES[i], (unsigned long)c.irCodes[i]);
+  }
+
+  if (n < 0 || (size_t)n >= size) return n;
+  n += snprintf(text + n, size - n, "apIp=%u.%u.%u.%u,apChannel=%u,apSsid=%s,apPassword=%s",
+                c.apIp[0], c.apIp[1], c.apIp[2], c.apIp[3], c.apChannel, c.apSsid, c.apPassword);
+  return n;
+}
+
+// ===== Storage =====
+ConfigError loadConfig(ConfigStore& store, CarConfig& config) {
+  alignas(4) uint8_t block[CONFIG_BLOCK_SIZE];
+  if (!store.read(block)) return CONFIG_ERR_STORE;
+  return decodeConfig(block, sizeof(block), config);
+}
+
+ConfigError saveConfig(ConfigStore& store, const CarConfig& config) {
+  ConfigError error = validateConfig(config);
+  if (error != CONFIG_OK) return error;
+
+  alignas(4) uint8_t block[CONFIG_BLOCK_SIZE];
+  encodeConfig(config, block);
+  return store.write(block) ? CONFIG_OK : CONFIG_ERR_STORE;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ===== Block Format =====
+// The persisted config is one fixed-size block:
+//
+//   'C' 'F' 'G' version:u8   length:u16   reserved:u16   crc32:u32
+//   payload[length]
+//
+// and the payload, in this order:
+//
+//   pwmSpeed:u16   turnSpeed:u16   garageSpeed:u8   cruiseSpeed:u8
+//   indicatorMs:u16   hornMs:u16   heartbeatMs:u32
+//   irCodes:u32[IR_BUTTON_COUNT]
+//   apIp:u8[4]   apChannel:u8   apSsid:char[32]   apPassword:char[64]
+//
+// Multi-byte values are little endian, strings are zero padded. New fields
+// are only ever appended: a block written by an older version loads the
+// fields it has and keeps the defaults for the rest.
+inline constexpr uint8_t CONFIG_MAGIC[3] = { 'C', 'F', 'G' };
+constexpr uint8_t CONFIG_VERSION = 1;
+constexpr size_t CONFIG_HEADER_SIZE = 12;
+constexpr size_t CONFIG_PAYLOAD_SIZE = 163;
+// Rounded up to whole 32-bit words, which is what flash reads and writes take
+constexpr size_t CONFIG_BLOCK_SIZE = (CONFIG_HEADER_SIZE + CONFIG_PAYLOAD_SIZE + 3) & ~(size_t)3;
+
+constexpr size_t CONFIG_SSID_SIZE = 32;
+constexpr size_t CONFIG_PASSWORD_SIZE = 64;
+
+// ===== Defaults =====
+constexpr uint16_t INDICATOR_INTERVAL = 500;
+constexpr uint16_t HORN_DURATION = 300;
+constexpr uint32_t HEARTBEAT_INTERVAL = 30000;
+
+// IR remote buttons, in payload order
+enum IrButton : uint8_t {
+  IR_STOP,
+  IR_FORWARD,
+  IR_BACKWARD,
+  IR_LEFT,
+  IR_RIGHT,
+  IR_HEADLIGHT,
+  IR_BRAKELIGHT,
+  IR_INDICATOR_LEFT,
+  IR_INDICATOR_RIGHT,
+  IR_HAZARD,
+  IR_HORN,
+  IR_GARAGE,
+  IR_BUTTON_COUNT
+};
+
+struct CarConfig {
+  uint16_t pwmSpeed = 800;     // duty at boot, 0..1023
+  uint16_t turnSpeed = 600;
+  uint8_t garageSpeed = 30;    // % while garage mode is on
+  uint8_t cruiseSpeed = 80;    // % after garage mode is switched off
+  uint16_t indicatorMs = INDICATOR_INTERVAL;
+  uint16_t hornMs = HORN_DURATION;
+  uint32_t heartbeatMs = HEARTBEAT_INTERVAL;
+
+  uint32_t irCodes[IR_BUTTON_COUNT] = {
+    0xFFA25D, 0xFF629D, 0xFFA857, 0xFF22DD, 0xFFC23D, 0xFF02FD,
+    0xFFE01F, 0xFF906F, 0xFF6897, 0xFF9867, 0xFFB04F, 0xFF30CF
+  };
+
+  uint8_t apIp[4] = { 192, 168, 10, 1 };
+  uint8_t apChannel = 1;
+  char apSsid[CONFIG_SSID_SIZE + 1] = "🚘 Nabil Remote Car 🚘";
+  char apPassword[CONFIG_PASSWORD_SIZE] = "123456789";
+};
+
+enum ConfigError : uint8_t {
+  CONFIG_OK = 0,
+  CONFIG_ERR_EMPTY,     // erased or never written
+  CONFIG_ERR_VERSION,   // written by a newer firmware
+  CONFIG_ERR_LENGTH,
+  CONFIG_ERR_CRC,
+  CONFIG_ERR_RANGE,     // a value outside what the car accepts
+  CONFIG_ERR_KEY,       // unknown key in a text edit
+  CONFIG_ERR_STORE      // storage read or write failed
+};
+
+const char* configErrorName(ConfigError error);
+
+// Any value check that decodeConfig() and setConfigValue() rely on
+ConfigError validateConfig(const CarConfig& config);
+
+// Writes CONFIG_BLOCK_SIZE bytes
+void encodeConfig(const CarConfig& config, uint8_t* block);
+// Leaves `config` untouched unless the whole block is good
+ConfigError decodeConfig(const uint8_t* block, size_t length, CarConfig& config);
+
+// ===== Text Form =====
+// "key=value" pairs as used over the WebSocket, e.g. "hornMs=500",
+// "ir.horn=0xFFB04F" or "apIp=192.168.10.1". Strings may not contain ','.
+ConfigError setConfigValue(CarConfig& config, const char* text, size_t length);
+// All pairs, comma separated; returns the length like snprintf
+int formatConfig(const CarConfig& config, char* text, size_t size);
+
+// ===== Storage =====
+// Where the block lives: a flash sector on the car, memory or a file on the
+// host. Blocks are CONFIG_BLOCK_SIZE bytes and 4-byte aligned.
+class ConfigStore {
+ public:
+  virtual ~ConfigStore() {}
+  virtual bool read(uint8_t* block) = 0;
+  virtual bool write(const uint8_t* block) = 0;
+};
+
+// One read; on any error `config` keeps its defaults
+ConfigError loadConfig(ConfigStore& store, CarConfig& config);
+ConfigError saveConfig(ConfigStore& store, const CarConfig& config);
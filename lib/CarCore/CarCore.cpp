@@ -0,0 +1,649 @@
+#include "CarCore.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+constexpr uint8_t ENABLE_PINS[2] = { ENB, ENA };  // per WheelSide
+
+const char* const DIRECTION_NAMES[] = { "stop", "forward", "backward", "left", "right" };
+
+bool is(const char* command, size_t length, const char* literal) {
+  size_t n = strlen(literal);
+  return length == n && memcmp(command, literal, n) == 0;
+}
+
+bool startsWith(const char* command, size_t length, const char* prefix) {
+  size_t n = strlen(prefix);
+  return length >= n && memcmp(command, prefix, n) == 0;
+}
+
+// Same result as Arduino's String::toInt(), without needing a terminator
+long toInt(const char* text, size_t length) {
+  size_t i = 0;
+  while (i < length && (text[i] == ' ' || text[i] == '\t')) i++;
+
+  bool negative = false;
+  if (i < length && (text[i] == '-' || text[i] == '+')) negative = text[i++] == '-';
+
+  long value = 0;
+  for (; i < length && text[i] >= '0' && text[i] <= '9'; i++) {
+    if (value > 100000000L) break;
+    value = value * 10 + (text[i] - '0');
+  }
+  return negative ? -value : value;
+}
+
+// Arduino map() as implemented by the ESP8266 core, rounding to nearest
+long mapRange(long x, long inMin, long inMax, long outMin, long outMax) {
+  const long dividend = outMax - outMin;
+  const long divisor = inMax - inMin;
+  const long delta = x - inMin;
+  return (delta * dividend + (divisor / 2)) / divisor + outMin;
+}
+
+int clampPercent(int value) {
+  return value < -100 ? -100 : (value > 100 ? 100 : value);
+}
+
+}  // namespace
+
+const char* directionName(Direction direction) {
+  return DIRECTION_NAMES[direction];
+}
+
+Car::Car(CarHal& hal, CarLink& link, CommandRecorder* recorder, ConfigStore* store)
+  : hal(hal), link(link), recorder(recorder), store(store) {}
+
+void Car::begin() {
+  state = CarState();
+  state.pwmSpeed = config.pwmSpeed;
+  state.turnSpeed = config.turnSpeed;
+  lights = LightSequencer();
+  script = MotionScript();
+
+  for (uint8_t side = 0; side < 2; side++) {
+    wheelMeters[side].reset(hal.encoderCount(side));
+    wheelPids[side].reset();
+    wheelDuty[side] = 0;
+  }
+
+  stopMotors();
+}
+
+void Car::carLog(const char* format, ...) {
+  char message[128];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+  hal.log(message);
+}
+
+RecordedState Car::recordedState() const {
+  uint8_t flags = 0;
+  if (state.headlightState) flags |= REC_FLAG_HEADLIGHT;
+  if (state.brakelightState) flags |= REC_FLAG_BRAKELIGHT;
+  if (state.indicatorLeftState) flags |= REC_FLAG_INDICATOR_LEFT;
+  if (state.indicatorRightState) flags |= REC_FLAG_INDICATOR_RIGHT;
+  if (state.hazardLightsState) flags |= REC_FLAG_HAZARD;
+  if (state.garageMode) flags |= REC_FLAG_GARAGE;
+  if (state.hornActive) flags |= REC_FLAG_HORN;
+  if (state.isMoving) flags |= REC_FLAG_MOVING;
+  return { state.currentDirection, (uint16_t)state.pwmSpeed, (uint16_t)state.turnSpeed, flags };
+}
+
+// ===== Dispatch =====
+// Every external input goes through here so it can be recorded together
+// with the state change it caused.
+void Car::onClientEvent(uint8_t num, ClientEvent event, const uint8_t* payload, size_t length) {
+  switch (event) {
+    case CLIENT_CONNECTED:
+      updateClientState(num);
+      break;
+
+    case CLIENT_DISCONNECTED:
+      break;
+
+    case CLIENT_TEXT:
+      if (length > 0) dispatchText(num, (const char*)payload, length);
+      break;
+
+    case CLIENT_BINARY:
+      dispatchBinary(num, payload, length);
+      break;
+  }
+}
+
+void Car::dispatchText(uint8_t num, const char* command, size_t length) {
+  uint32_t now = hal.millis();
+  RecordedState before = recordedState();
+
+  handleWebSocketCommand(num, command, length);
+
+  // Queries do not change anything and would flood the log
+  if (recorder && !is(command, length, "getState") && !is(command, length, "ping") &&
+      !is(command, length, "config:get")) {
+    recorder->record(now, REC_TEXT, num, (const uint8_t*)command, length,
+                     before, recordedState());
+  }
+}
+
+void Car::dispatchBinary(uint8_t num, const uint8_t* payload, size_t length) {
+  uint32_t now = hal.millis();
+  RecordedState before = recordedState();
+
+  handleScriptUpload(num, payload, length);
+
+  if (recorder) {
+    recorder->record(now, REC_BINARY, num, payload, length, before, recordedState());
+  }
+}
+
+void Car::dispatchIR(uint32_t value) {
+  uint32_t now = hal.millis();
+  RecordedState before = recordedState();
+
+  handleIRCommand(value);
+
+  if (recorder) {
+    const uint8_t code[4] = {
+      (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)
+    };
+    recorder->record(now, REC_IR, 0, code, sizeof(code), before, recordedState());
+  }
+}
+
+// ===== Command Handler =====
+void Car::handleWebSocketCommand(uint8_t num, const char* command, size_t length) {
+  DEBUG_LOG("Received command: %.*s", (int)length, command);
+  
+  // Any manual input takes over from a running script
+  bool scriptCommand = startsWith(command, length, "script:");
+  bool configCommand = startsWith(command, length, "config:");
+  if (!scriptCommand && !configCommand && !is(command, length, "getState") && !is(command, length, "ping")) {
+    script.abort();
+  }
+  
+  if (is(command, length, "forward")) moveForward();
+  else if (is(command, length, "backward")) moveBackward();
+  else if (is(command, length, "left")) turnLeft();
+  else if (is(command, length, "right")) turnRight();
+  else if (is(command, length, "stop")) stopMotors();
+  else if (startsWith(command, length, "speed:")) setSpeed(toInt(command + 6, length - 6));
+  else if (is(command, length, "headlight:on")) { if (!state.headlightState) toggleHeadlight(); }
+  else if (is(command, length, "headlight:off")) { if (state.headlightState) toggleHeadlight(); }
+  else if (is(command, length, "brakelight:on")) { if (!state.brakelightState) toggleBrakelight(); }
+  else if (is(command, length, "brakelight:off")) { if (state.brakelightState) toggleBrakelight(); }
+  else if (is(command, length, "indicator-left:on")) { if (!state.indicatorLeftState) toggleLeftIndicator(); }
+  else if (is(command, length, "indicator-left:off")) { if (state.indicatorLeftState) toggleLeftIndicator(); }
+  else if (is(command, length, "indicator-right:on")) { if (!state.indicatorRightState) toggleRightIndicator(); }
+  else if (is(command, length, "indicator-right:off")) { if (state.indicatorRightState) toggleRightIndicator(); }
+  else if (is(command, length, "hazard:on")) { if (!state.hazardLightsState) toggleHazardLights(); }
+  else if (is(command, length, "hazard:off")) { if (state.hazardLightsState) toggleHazardLights(); }
+  else if (is(command, length, "horn")) soundHorn();
+  else if (is(command, length, "garage")) toggleGarageMode();
+  else if (is(command, length, "speedctl:on")) setSpeedControl(true);
+  else if (is(command, length, "speedctl:off")) setSpeedControl(false);
+  else if (startsWith(command, length, "fx:")) handleLightEffect(command, length);
+  else if (scriptCommand) handleScriptCommand(num, command, length);
+  else if (configCommand) handleConfigCommand(num, command, length);
+  else if (is(command, length, "getState")) updateClientState(num);
+  else if (is(command, length, "ping")) link.send(num, "pong", 4);
+  
+  // Broadcast state changes to all clients
+  broadcastState();
+}
+
+// ===== IR Remote Handler =====
+void Car::handleIRCommand(unsigned long value) {
+  unsigned long now = hal.millis();
+  if (now - state.lastIRCommand < DEBOUNCE_DELAY) return;
+  
+  state.lastIRCommand = now;
+  script.abort();
+  
+  DEBUG_LOG("IR Command: 0x%lX", value);
+  
+  uint8_t button = 0;
+  while (button < IR_BUTTON_COUNT && config.irCodes[button] != value) button++;
+  
+  switch(button) {
+    case IR_STOP: stopMotors(); break;
+    case IR_FORWARD: moveForward(); break;
+    case IR_BACKWARD: moveBackward(); break;
+    case IR_LEFT: turnLeft(); break;
+    case IR_RIGHT: turnRight(); break;
+    case IR_HEADLIGHT: toggleHeadlight(); break;
+    case IR_BRAKELIGHT: toggleBrakelight(); break;
+    case IR_INDICATOR_LEFT: toggleLeftIndicator(); break;
+    case IR_INDICATOR_RIGHT: toggleRightIndicator(); break;
+    case IR_HAZARD: toggleHazardLights(); break;
+    case IR_HORN: soundHorn(); break;
+    case IR_GARAGE: toggleGarageMode(); break;
+    default: DEBUG_LOG("Unknown IR command");
+  }
+  
+  broadcastState();
+}
+
+// ===== Motor Control =====
+void Car::applyMotor(bool in1, bool in2, bool in3, bool in4, int ena, int enb) {
+  hal.pinWrite(IN1, in1); hal.pinWrite(IN2, in2);
+  hal.pinWrite(IN3, in3); hal.pinWrite(IN4, in4);
+  
+  const int8_t direction[2] = { (int8_t)(in3 - in4), (int8_t)(in1 - in2) };
+  const uint16_t target[2] = { (uint16_t)enb, (uint16_t)ena };
+  
+  for (uint8_t side = 0; side < 2; side++) {
+    if (direction[side] != state.motorDirection[side]) wheelPids[side].reset();
+    state.motorDirection[side] = direction[side];
+    state.motorTarget[side] = target[side];
+    
+    // Open loop, and stopping in closed loop, never wait for the next tick
+    if (!closedLoop() || target[side] == 0) {
+      wheelDuty[side] = target[side];
+      hal.pwmWrite(ENABLE_PINS[side], target[side]);
+    }
+  }
+}
+
+// ===== Speed Control =====
+bool Car::closedLoop() const {
+  return state.speedControl && hal.hasEncoders();
+}
+
+void Car::setSpeedControl(bool on) {
+  state.speedControl = on;
+  for (uint8_t side = 0; side < 2; side++) {
+    wheelPids[side].reset();
+    if (!closedLoop()) {
+      wheelDuty[side] = state.motorTarget[side];
+      hal.pwmWrite(ENABLE_PINS[side], state.motorTarget[side]);
+    }
+  }
+}
+
+void Car::lockMotors(bool locked) {
+  if (locked) {
+    script.abort();
+    stopMotors();
+  }
+  state.motorsLocked = locked;
+  broadcastState();
+}
+
+// Runs on the control tick: one PID update per wheel
+void Car::updateSpeedControl() {
+  if (!hal.hasEncoders()) return;
+  
+  for (uint8_t side = 0; side < 2; side++) {
+    state.wheelSpeed[side] = wheelMeters[side].update(hal.encoderCount(side), CONTROL_TICK_MS);
+    if (!state.speedControl) continue;
+    
+    int32_t target = (int32_t)state.motorTarget[side] * SPEED_MAX_CPS / PWM_MAX;
+    uint16_t duty = wheelPids[side].update(target, state.wheelSpeed[side]);
+    if (duty != wheelDuty[side]) {
+      wheelDuty[side] = duty;
+      hal.pwmWrite(ENABLE_PINS[side], duty);
+    }
+  }
+}
+
+void Car::setSpeed(int speedPercent) {
+  // "speed:" arguments arrive unchecked; anything outside 0..100 would map
+  // to a duty outside 0..PWM_MAX
+  speedPercent = speedPercent < 0 ? 0 : (speedPercent > 100 ? 100 : speedPercent);
+  
+  state.pwmSpeed = mapRange(speedPercent, 0, 100, 0, PWM_MAX);
+  state.turnSpeed = mapRange(speedPercent, 0, 100, 0, 800);
+  applyDirection();
+}
+
+// Re-drives the current direction, e.g. with a new speed
+void Car::applyDirection() {
+  switch (state.currentDirection) {
+    case DIR_FORWARD: moveForward(); break;
+    case DIR_BACKWARD: moveBackward(); break;
+    case DIR_LEFT: turnLeft(); break;
+    case DIR_RIGHT: turnRight(); break;
+    default: break;
+  }
+}
+
+void Car::moveForward() {
+  if (state.motorsLocked) return;
+  applyMotor(true, false, true, false, state.pwmSpeed, state.pwmSpeed);
+  state.currentDirection = DIR_FORWARD;
+  state.isMoving = true;
+  if (state.brakelightState) toggleBrakelight();
+}
+
+void Car::moveBackward() {
+  if (state.motorsLocked) return;
+  applyMotor(false, true, false, true, state.pwmSpeed, state.pwmSpeed);
+  state.currentDirection = DIR_BACKWARD;
+  state.isMoving = true;
+  if (!state.brakelightState) toggleBrakelight();
+}
+
+void Car::turnLeft() {
+  if (state.motorsLocked) return;
+  applyMotor(true, false, false, true, state.turnSpeed, state.turnSpeed);
+  state.currentDirection = DIR_LEFT;
+  state.isMoving = true;
+  if (!state.indicatorLeftState && !state.hazardLightsState) toggleLeftIndicator();
+}
+
+void Car::turnRight() {
+  if (state.motorsLocked) return;
+  applyMotor(false, true, true, false, state.turnSpeed, state.turnSpeed);
+  state.currentDirection = DIR_RIGHT;
+  state.isMoving = true;
+  if (!state.indicatorRightState && !state.hazardLightsState) toggleRightIndicator();
+}
+
+void Car::stopMotors() {
+  applyMotor(false, false, false, false, 0, 0);
+  state.currentDirection = DIR_STOP;
+  state.isMoving = false;
+  if (!state.brakelightState) toggleBrakelight();
+  if (state.indicatorLeftState && !state.hazardLightsState) toggleLeftIndicator();
+  if (state.indicatorRightState && !state.hazardLightsState) toggleRightIndicator();
+}
+
+// Differential drive, -100..100 % per side. Motor A (ENA) is the right side.
+void Car::driveVector(int left, int right) {
+  if (state.motorsLocked) return;
+  left = clampPercent(left);
+  right = clampPercent(right);
+  
+  applyMotor(right > 0, right < 0, left > 0, left < 0,
+             mapRange(right < 0 ? -right : right, 0, 100, 0, PWM_MAX),
+             mapRange(left < 0 ? -left : left, 0, 100, 0, PWM_MAX));
+  
+  if (left == 0 && right == 0) state.currentDirection = DIR_STOP;
+  else if (left > 0 && right > 0) state.currentDirection = DIR_FORWARD;
+  else if (left < 0 && right < 0) state.currentDirection = DIR_BACKWARD;
+  else if (left < right) state.currentDirection = DIR_LEFT;
+  else state.currentDirection = DIR_RIGHT;
+  state.isMoving = left != 0 || right != 0;
+}
+
+// ===== Feature Control =====
+void Car::toggleHeadlight() {
+  state.headlightState = !state.headlightState;
+  lights.play(CH_HEADLIGHT, state.headlightState ? PATTERN_ON : PATTERN_OFF);
+}
+
+void Car::toggleBrakelight() {
+  state.brakelightState = !state.brakelightState;
+  lights.play(CH_BRAKELIGHT, state.brakelightState ? PATTERN_ON : PATTERN_OFF);
+}
+
+void Car::toggleLeftIndicator() {
+  state.indicatorLeftState = !state.indicatorLeftState;
+  if (state.hazardLightsState) state.hazardLightsState = false;
+  updateIndicatorLights();
+}
+
+void Car::toggleRightIndicator() {
+  state.indicatorRightState = !state.indicatorRightState;
+  if (state.hazardLightsState) state.hazardLightsState = false;
+  updateIndicatorLights();
+}
+
+void Car::toggleHazardLights() {
+  state.hazardLightsState = !state.hazardLightsState;
+  state.indicatorLeftState = false;
+  state.indicatorRightState = false;
+  updateIndicatorLights();
+}
+
+void Car::soundHorn() {
+  lights.play(CH_HORN, PATTERN_BEEP, lightTicks(config.hornMs));
+  state.hornActive = true;
+}
+
+void Car::toggleGarageMode() {
+  state.garageMode = !state.garageMode;
+  if (state.garageMode) {
+    setSpeed(config.garageSpeed);
+    if (!state.headlightState) toggleHeadlight();
+  } else {
+    setSpeed(config.cruiseSpeed);
+  }
+}
+
+// ===== Light Effects =====
+// "fx:<channel>:<effect>", e.g. "fx:headlight:breathe" or "fx:horn:chirp"
+void Car::handleLightEffect(const char* command, size_t length) {
+  const char* name = command + 3;
+  const char* sep = (const char*)memchr(name, ':', length - 3);
+  if (!sep) return;
+
+  char channelName[16];
+  char effectName[16];
+  size_t channelLength = sep - name;
+  size_t effectLength = command + length - (sep + 1);
+  if (channelLength >= sizeof(channelName) || effectLength >= sizeof(effectName)) return;
+
+  memcpy(channelName, name, channelLength);
+  channelName[channelLength] = '\0';
+  memcpy(effectName, sep + 1, effectLength);
+  effectName[effectLength] = '\0';
+
+  int channel = findLightChannel(channelName);
+  const LightPattern* pattern = findLightEffect(effectName);
+  if (channel < 0 || !pattern) {
+    DEBUG_LOG("Unknown light effect");
+    return;
+  }
+
+  lights.play(channel, *pattern);
+
+  bool on = lights.active(channel);
+  switch (channel) {
+    case CH_HEADLIGHT: state.headlightState = on; break;
+    case CH_BRAKELIGHT: state.brakelightState = on; break;
+    case CH_HORN: state.hornActive = on; break;
+    default: break;
+  }
+}
+
+// Both sides restart together so hazard blinks stay in phase
+void Car::updateIndicatorLights() {
+  const uint8_t blinkTicks = lightTicks(config.indicatorMs);
+  bool left = state.hazardLightsState || state.indicatorLeftState;
+  bool right = state.hazardLightsState || state.indicatorRightState;
+
+  lights.play(CH_INDICATOR_LEFT, left ? PATTERN_BLINK : PATTERN_OFF, blinkTicks);
+  lights.play(CH_INDICATOR_RIGHT, right ? PATTERN_BLINK : PATTERN_OFF, blinkTicks);
+}
+
+// ===== Motion Scripts =====
+void Car::ScriptTarget::drive(int8_t left, int8_t right) {
+  car.driveVector(left, right);
+  car.state.stateChanged = true;
+}
+
+void Car::ScriptTarget::lights(uint8_t mask) {
+  car.setScriptLights(mask);
+  car.state.stateChanged = true;
+}
+
+void Car::ScriptTarget::horn(uint8_t effect) {
+  if (effect == SCRIPT_HORN_CHIRP) {
+    car.lights.play(CH_HORN, PATTERN_CHIRP);
+    car.state.hornActive = true;
+  } else {
+    car.soundHorn();
+  }
+}
+
+void Car::handleScriptUpload(uint8_t num, const uint8_t* payload, size_t length) {
+  size_t offset = 0;
+  ScriptError error = script.load(payload, length, &offset);
+  
+  char reply[48];
+  int n;
+  if (error == SCRIPT_OK) {
+    n = snprintf(reply, sizeof(reply), "script:ok:%u", (unsigned)length);
+  } else {
+    n = snprintf(reply, sizeof(reply), "script:error:%s:%u", scriptErrorName(error), (unsigned)offset);
+  }
+  link.send(num, reply, n);
+  broadcastState();
+}
+
+// "script:run" or "script:stop"
+void Car::handleScriptCommand(uint8_t num, const char* command, size_t length) {
+  if (is(command, length, "script:run")) {
+    if (state.motorsLocked) link.send(num, "script:error:locked", 19);
+    else if (!script.start(scriptTarget)) link.send(num, "script:error:empty", 18);
+  } else if (is(command, length, "script:stop")) {
+    script.abort();
+  }
+}
+
+void Car::setScriptLights(uint8_t mask) {
+  if (state.headlightState != bool(mask & SCRIPT_LIGHT_HEADLIGHT)) toggleHeadlight();
+  if (state.brakelightState != bool(mask & SCRIPT_LIGHT_BRAKELIGHT)) toggleBrakelight();
+  
+  state.hazardLightsState = mask & SCRIPT_LIGHT_HAZARD;
+  state.indicatorLeftState = !state.hazardLightsState && (mask & SCRIPT_LIGHT_LEFT);
+  state.indicatorRightState = !state.hazardLightsState && (mask & SCRIPT_LIGHT_RIGHT);
+  updateIndicatorLights();
+}
+
+// ===== Configuration =====
+// "config:get", "config:set:<key>=<value>", "config:save" and
+// "config:reset". Edits apply at once except the AP settings, which take
+// effect at the next boot; nothing is persisted until "config:save".
+void Car::handleConfigCommand(uint8_t num, const char* command, size_t length) {
+  char reply[640];
+  int n;
+  
+  if (is(command, length, "config:get")) {
+    n = snprintf(reply, sizeof(reply), "config:");
+    n += formatConfig(config, reply + n, sizeof(reply) - n);
+    if (n >= (int)sizeof(reply)) n = sizeof(reply) - 1;
+    link.send(num, reply, n);
+    return;
+  }
+  
+  CarConfig previous = config;
+  ConfigError error;
+  const char* what = command + 7;
+  size_t whatLength = length - 7;
+  
+  if (startsWith(command, length, "config:set:")) {
+    const char* pair = command + 11;
+    size_t pairLength = length - 11;
+    error = setConfigValue(config, pair, pairLength);
+    const char* sep = (const char*)memchr(pair, '=', pairLength);
+    what = pair;
+    whatLength = sep ? (size_t)(sep - pair) : pairLength;
+  } else if (is(command, length, "config:reset")) {
+    config = CarConfig();
+    error = CONFIG_OK;
+  } else if (is(command, length, "config:save")) {
+    error = store ? saveConfig(*store, config) : CONFIG_ERR_STORE;
+  } else {
+    error = CONFIG_ERR_KEY;
+  }
+  
+  if (error == CONFIG_OK) {
+    n = snprintf(reply, sizeof(reply), "config:ok:%.*s", (int)whatLength, what);
+  } else {
+    n = snprintf(reply, sizeof(reply), "config:error:%s:%.*s", configErrorName(error), (int)whatLength, what);
+  }
+  if (n >= (int)sizeof(reply)) n = sizeof(reply) - 1;
+  link.send(num, reply, n);
+  
+  // New boot speeds take over from whatever the slider set
+  if (config.pwmSpeed != previous.pwmSpeed || config.turnSpeed != previous.turnSpeed) {
+    state.pwmSpeed = config.pwmSpeed;
+    state.turnSpeed = config.turnSpeed;
+    applyDirection();
+  }
+}
+
+// ===== Control Tick =====
+// Scripts and light patterns advance together on a fixed tick
+void Car::handleControlTick() {
+  unsigned long now = hal.millis();
+
+  // Resync instead of replaying a burst of ticks after a long stall
+  if (now - state.lastControlTick >= 10UL * CONTROL_TICK_MS) {
+    state.lastControlTick = now - CONTROL_TICK_MS;
+  }
+
+  while (now - state.lastControlTick >= CONTROL_TICK_MS) {
+    state.lastControlTick += CONTROL_TICK_MS;
+    script.tick(CONTROL_TICK_MS);
+    updateSpeedControl();
+    applyLights(lights.tick());
+  }
+
+  state.hornActive = lights.active(CH_HORN);
+  
+  if (state.stateChanged) {
+    state.stateChanged = false;
+    broadcastState();
+  }
+}
+
+void Car::applyLights(uint8_t changedMask) {
+  for (uint8_t ch = 0; changedMask; ch++, changedMask >>= 1) {
+    if (!(changedMask & 1)) continue;
+
+    uint16_t level = lights.level(ch);
+    if (level == 0 || level == LIGHT_LEVEL_MAX) {
+      hal.pinWrite(LIGHT_PINS[ch], level != 0);
+    } else {
+      hal.pwmWrite(LIGHT_PINS[ch], level);
+    }
+  }
+}
+
+// ===== State Management =====
+int Car::formatState(char* text, size_t size) const {
+  return snprintf(text, size,
+    "state:direction:%s,speed:%ld,headlight:%s,brakelight:%s,"
+    "indicatorLeft:%s,indicatorRight:%s,hazard:%s,script:%s",
+    directionName(state.currentDirection),
+    mapRange(state.pwmSpeed, 0, PWM_MAX, 0, 100),
+    state.headlightState ? "on" : "off",
+    state.brakelightState ? "on" : "off",
+    state.indicatorLeftState ? "on" : "off",
+    state.indicatorRightState ? "on" : "off",
+    state.hazardLightsState ? "on" : "off",
+    script.running() ? "on" : "off");
+}
+
+void Car::updateClientState(uint8_t num) {
+  char text[192];
+  int n = formatState(text, sizeof(text));
+  link.send(num, text, n);
+}
+
+// Client numbers are slots and can have gaps after a disconnect, so this
+// cannot loop over 0..clientCount()-1
+void Car::broadcastState() {
+  if (link.clientCount() == 0) return;
+
+  char text[192];
+  int n = formatState(text, sizeof(text));
+  link.broadcast(text, n);
+}
+
+void Car::sendHeartbeat() {
+  unsigned long now = hal.millis();
+  if (now - state.lastHeartbeat >= config.heartbeatMs) {
+    state.lastHeartbeat = now;
+    link.broadcast("heartbeat", 9);
+  }
+}
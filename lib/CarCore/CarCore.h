@@ -0,0 +1,213 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CarHal.h"
+#include <CarConfig.h>
+#include <CommandRecorder.h>
+#include <LightSequencer.h>
+#include <MotionScript.h>
+#include <SpeedControl.h>
+
+// ===== Configuration =====
+#ifndef DEBUG_MODE
+#define DEBUG_MODE true
+#endif
+
+// Wheel encoders on SD2/SD3. SD3 is also the IR receiver input, so a build
+// with encoders has no IR remote.
+#ifndef WHEEL_ENCODERS
+#define WHEEL_ENCODERS false
+#endif
+
+#if DEBUG_MODE
+  #define DEBUG_LOG(...) carLog(__VA_ARGS__)
+#else
+  #define DEBUG_LOG(...)
+#endif
+
+// ===== Pin Definitions =====
+constexpr uint8_t ENA = 5;   // D1
+constexpr uint8_t ENB = 4;   // D2
+constexpr uint8_t IN1 = 0;   // D3
+constexpr uint8_t IN2 = 2;   // D4
+constexpr uint8_t IN3 = 14;  // D5
+constexpr uint8_t IN4 = 12;  // D6
+constexpr uint8_t HEADLIGHT_PIN = 13;   // D7
+constexpr uint8_t BRAKELIGHT_PIN = 15;  // D8
+constexpr uint8_t INDICATOR_LEFT = 16;  // D0
+constexpr uint8_t INDICATOR_RIGHT = 3;  // RX
+constexpr uint8_t HORN_PIN = 1;         // TX
+constexpr uint8_t IR_RECV_PIN = 10;     // SD3
+constexpr uint8_t ENCODER_LEFT_PIN = 9;   // SD2
+constexpr uint8_t ENCODER_RIGHT_PIN = 10; // SD3
+
+// The H-bridge pins, driven low first thing at boot
+inline constexpr uint8_t MOTOR_PINS[] = { ENA, ENB, IN1, IN2, IN3, IN4 };
+
+inline constexpr uint8_t OUTPUT_PINS[] = {
+  ENA, ENB, IN1, IN2, IN3, IN4,
+  HEADLIGHT_PIN, BRAKELIGHT_PIN,
+  INDICATOR_LEFT, INDICATOR_RIGHT, HORN_PIN
+};
+
+// Output pin of each LightSequencer channel
+inline constexpr uint8_t LIGHT_PINS[CH_COUNT] = {
+  HEADLIGHT_PIN, BRAKELIGHT_PIN, INDICATOR_LEFT, INDICATOR_RIGHT, HORN_PIN
+};
+
+// ===== Constants =====
+constexpr uint16_t WS_RECONNECT_INTERVAL = 2000;
+constexpr uint16_t DEBOUNCE_DELAY = 200;
+constexpr uint16_t CONTROL_TICK_MS = LIGHT_TICK_MS;
+constexpr uint16_t PWM_MAX = 1023;
+
+// ===== Speed Control =====
+// With encoders, motor duty becomes a speed target: PWM_MAX asks for
+// SPEED_MAX_CPS. It sits below the free-running speed so that it can still
+// be held on a low battery.
+constexpr uint16_t ENCODER_CPR = 20;
+constexpr int32_t SPEED_MAX_CPS = 75;
+constexpr PidGains SPEED_PID_GAINS = { 10970, 6144, 1024, 0 };
+
+// ===== Car State =====
+enum Direction : uint8_t {
+  DIR_STOP,
+  DIR_FORWARD,
+  DIR_BACKWARD,
+  DIR_LEFT,
+  DIR_RIGHT
+};
+
+const char* directionName(Direction direction);
+
+struct CarState {
+  int pwmSpeed = 800;
+  int turnSpeed = 600;
+  bool isMoving = false;
+  Direction currentDirection = DIR_STOP;
+  
+  bool headlightState = false;
+  bool brakelightState = false;
+  bool indicatorLeftState = false;
+  bool indicatorRightState = false;
+  bool hazardLightsState = false;
+  bool garageMode = false;
+  bool hornActive = false;
+  bool stateChanged = false;
+  bool speedControl = true;
+  bool motorsLocked = false;         // while a firmware update is written
+  
+  uint16_t motorTarget[2] = {0, 0};  // per WheelSide, 0..PWM_MAX
+  int8_t motorDirection[2] = {0, 0};
+  int32_t wheelSpeed[2] = {0, 0};    // counts per second, when encoders are fitted
+  
+  unsigned long lastControlTick = 0;
+  unsigned long lastHeartbeat = 0;
+  unsigned long lastIRCommand = 0;
+};
+
+// What a WebSocket server reports about a client, independent of the library
+enum ClientEvent : uint8_t {
+  CLIENT_CONNECTED,
+  CLIENT_DISCONNECTED,
+  CLIENT_TEXT,
+  CLIENT_BINARY
+};
+
+// ===== Car =====
+// One vehicle: its state, light patterns and motion script, driving the
+// board through a CarHal and reporting to controllers through a CarLink.
+// Instances share nothing, so a host process can run as many as it likes.
+class Car {
+ public:
+  // `recorder` and `store` are optional; with a recorder every dispatched
+  // command is logged, with a store "config:save" persists the config.
+  Car(CarHal& hal, CarLink& link, CommandRecorder* recorder = nullptr,
+      ConfigStore* store = nullptr);
+
+  // Back to the power-on state with the speeds from `config`: lights off,
+  // no script, motors stopped
+  void begin();
+
+  // ===== Entry Points =====
+  // The WebSocket event handler: the firmware and the host server both
+  // route their client events through here
+  void onClientEvent(uint8_t num, ClientEvent event, const uint8_t* payload, size_t length);
+  void dispatchText(uint8_t num, const char* command, size_t length);
+  void dispatchBinary(uint8_t num, const uint8_t* payload, size_t length);
+  void dispatchIR(uint32_t value);
+
+  RecordedState recordedState() const;
+  void carLog(const char* format, ...);
+
+  // ===== Commands =====
+  void handleWebSocketCommand(uint8_t num, const char* command, size_t length);
+  void handleIRCommand(unsigned long value);
+  void setSpeed(int speedPercent);
+  void moveForward();
+  void moveBackward();
+  void turnLeft();
+  void turnRight();
+  void stopMotors();
+  void driveVector(int left, int right);
+  void toggleHeadlight();
+  void toggleBrakelight();
+  void toggleLeftIndicator();
+  void toggleRightIndicator();
+  void toggleHazardLights();
+  void soundHorn();
+  void toggleGarageMode();
+  void setSpeedControl(bool on);
+  // Stops the car and ignores drive commands and scripts until unlocked
+  void lockMotors(bool locked);
+
+  // ===== Loop =====
+  void handleControlTick();
+  void sendHeartbeat();
+  void updateClientState(uint8_t num);
+  void broadcastState();
+
+  CarConfig config;
+  CarState state;
+  LightSequencer lights;
+  MotionScript script;
+
+ private:
+  // Lets a running script drive this car
+  class ScriptTarget : public MotionTarget {
+   public:
+    explicit ScriptTarget(Car& car) : car(car) {}
+    void drive(int8_t left, int8_t right) override;
+    void lights(uint8_t mask) override;
+    void horn(uint8_t effect) override;
+
+   private:
+    Car& car;
+  };
+
+  void handleLightEffect(const char* command, size_t length);
+  void updateIndicatorLights();
+  void handleScriptUpload(uint8_t num, const uint8_t* payload, size_t length);
+  void handleScriptCommand(uint8_t num, const char* command, size_t length);
+  void handleConfigCommand(uint8_t num, const char* command, size_t length);
+  void applyDirection();
+  void setScriptLights(uint8_t mask);
+  void applyLights(uint8_t changedMask);
+  void applyMotor(bool in1, bool in2, bool in3, bool in4, int ena, int enb);
+  bool closedLoop() const;
+  void updateSpeedControl();
+  int formatState(char* text, size_t size) const;
+
+  CarHal& hal;
+  CarLink& link;
+  CommandRecorder* recorder;
+  ConfigStore* store;
+
+  WheelSpeedMeter wheelMeters[2];
+  WheelPid wheelPids[2] = { WheelPid(SPEED_PID_GAINS, PWM_MAX), WheelPid(SPEED_PID_GAINS, PWM_MAX) };
+  uint16_t wheelDuty[2] = {0, 0};
+
+  ScriptTarget scriptTarget{*this};
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum WheelSide : uint8_t { WHEEL_LEFT, WHEEL_RIGHT };
+
+// ===== Hardware Abstraction =====
+// Everything the car logic needs from the board. The firmware implements it
+// on top of the Arduino core, native builds with a virtual clock.
+class CarHal {
+ public:
+  virtual ~CarHal() {}
+  virtual void pinWrite(uint8_t pin, bool level) = 0;
+  virtual void pwmWrite(uint8_t pin, uint16_t duty) = 0;
+  virtual uint32_t millis() = 0;
+  // Rising edges seen so far on a single-channel wheel encoder
+  virtual bool hasEncoders() { return false; }
+  virtual uint32_t encoderCount(uint8_t side) { (void)side; return 0; }
+  virtual void log(const char* message) { (void)message; }
+};
+
+// ===== Client Transport =====
+// How state and replies reach the connected controllers.
+class CarLink {
+ public:
+  virtual ~CarLink() {}
+  virtual void send(uint8_t client, const char* text, size_t length) = 0;
+  virtual void broadcast(const char* text, size_t length) = 0;
+  virtual uint8_t clientCount() = 0;
+};
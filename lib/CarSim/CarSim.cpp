@@ -0,0 +1,83 @@
+#include "CarSim.h"
+
+#include <math.h>
+
+#include <CarCore.h>
+
+namespace {
+
+constexpr double TWO_PI = 6.283185307179586;
+
+double clamp(double value, double lo, double hi) {
+  return value < lo ? lo : (value > hi ? hi : value);
+}
+
+}  // namespace
+
+CarSim::CarSim(const PlantParams& p) : params(p), voltage(p.batteryVoltage) {}
+
+void CarSim::pinWrite(uint8_t p, bool level) {
+  if (p < PIN_COUNT) pins[p] = level ? PWM_MAX : 0;
+}
+
+void CarSim::pwmWrite(uint8_t p, uint16_t duty) {
+  if (p < PIN_COUNT) pins[p] = duty > PWM_MAX ? PWM_MAX : duty;
+}
+
+void CarSim::advance(uint32_t ms) {
+  for (uint32_t i = 0; i < ms; i++) {
+    // Battery sag from the current drawn during the previous step
+    double load = wheels[LEFT].current + wheels[RIGHT].current;
+    voltage = params.batteryVoltage - params.batteryResistance * load;
+    if (voltage < 0) voltage = 0;
+
+    // Motor A (ENA, IN1/IN2) is the right side, motor B the left
+    stepWheel(wheels[RIGHT], pin(IN1), pin(IN2), pin(ENA),
+              params.freeSpeed * (1 + params.sideMismatch), STEP_S);
+    stepWheel(wheels[LEFT], pin(IN3), pin(IN4), pin(ENB), params.freeSpeed, STEP_S);
+
+    double v = speed();
+    double w = yawRate();
+    x += v * cos(heading) * STEP_S;
+    y += v * sin(heading) * STEP_S;
+    heading += w * STEP_S;
+    distance += fabs(v) * STEP_S;
+    nowMs++;
+  }
+}
+
+void CarSim::stepWheel(Wheel& wheel, bool inA, bool inB, uint16_t duty, double freeSpeed, double dt) {
+  const double d = (double)duty / PWM_MAX;
+  const double supply = voltage / params.nominalVoltage;
+
+  if (d > 0 && inA != inB) {
+    // Driven: first-order approach to the speed this duty and voltage allow
+    double target = freeSpeed * d * supply * (inA ? 1 : -1);
+    wheel.omega += (target - wheel.omega) * dt / params.motorTau;
+
+    double backEmf = fabs(wheel.omega) / (freeSpeed * (supply > 0 ? supply : 1e-9));
+    wheel.current = params.stallCurrent * d * supply * clamp(1 - backEmf, 0, 1);
+  } else if (d > 0) {
+    // Both inputs equal with the bridge enabled: dynamic braking
+    wheel.omega -= wheel.omega * dt / params.brakeTau * d;
+    wheel.current = 0;
+  } else {
+    wheel.omega -= wheel.omega * dt / params.coastTau;
+    wheel.current = 0;
+  }
+
+  // Ground speed follows the wheel up to what traction allows
+  double surface = wheel.omega * params.wheelRadius;
+  if (params.tractionLimit > 0) {
+    double maxStep = params.tractionLimit * dt;
+    wheel.ground += clamp(surface - wheel.ground, -maxStep, maxStep);
+  } else {
+    wheel.ground = surface;
+  }
+
+  // Single-channel encoder: counts edges whichever way the wheel turns
+  wheel.travel += fabs(wheel.omega) * dt;
+  if (params.encoderCpr) {
+    wheel.count = (uint32_t)floor(wheel.travel * params.encoderCpr / TWO_PI);
+  }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <CarHal.h>
+
+// ===== Plant Parameters =====
+// Defaults approximate a 2WD chassis with TT gear motors on an L298N and a
+// 2S Li-ion pack.
+struct PlantParams {
+  double wheelRadius = 0.033;      // m
+  double trackWidth = 0.13;        // m, wheel to wheel
+  double motorTau = 0.12;          // s, first-order speed response
+  double coastTau = 0.35;          // s, spin-down with the bridge disabled
+  double brakeTau = 0.05;          // s, spin-down with both inputs equal
+  double freeSpeed = 30.0;         // rad/s at nominal voltage and full duty
+  double sideMismatch = 0.0;       // right motor speed relative to left, 0.05 = 5 % faster
+  double stallCurrent = 1.5;       // A per motor at nominal voltage
+  double nominalVoltage = 7.4;     // V the free speed was measured at
+  double batteryVoltage = 7.4;     // V open circuit
+  double batteryResistance = 0.4;  // ohm, pack plus wiring plus bridge
+  double tractionLimit = 0.0;      // m/s^2 a wheel can transfer, 0 = no slip
+  uint16_t encoderCpr = 0;         // counts per wheel revolution, 0 = none
+};
+
+// ===== Simulator =====
+// A CarHal whose pins drive a differential-drive plant instead of hardware.
+// Time is simulated: it only advances through advance(), in fixed steps.
+class CarSim : public CarHal {
+ public:
+  static constexpr uint8_t PIN_COUNT = 17;
+  static constexpr double STEP_S = 0.001;
+
+  enum Side : uint8_t { LEFT = WHEEL_LEFT, RIGHT = WHEEL_RIGHT };
+
+  explicit CarSim(const PlantParams& params = PlantParams());
+
+  // CarHal
+  void pinWrite(uint8_t pin, bool level) override;
+  void pwmWrite(uint8_t pin, uint16_t duty) override;
+  uint32_t millis() override { return nowMs; }
+  bool hasEncoders() override { return params.encoderCpr > 0; }
+  uint32_t encoderCount(uint8_t side) override { return side < 2 ? wheels[side].count : 0; }
+
+  void advance(uint32_t ms);
+
+  // Wheel surface speed and ground speed of one side, m/s
+  double wheelSpeed(Side side) const { return wheels[side].omega * params.wheelRadius; }
+  double groundSpeed(Side side) const { return wheels[side].ground; }
+  double speed() const { return (wheels[LEFT].ground + wheels[RIGHT].ground) / 2; }
+  double yawRate() const { return (wheels[RIGHT].ground - wheels[LEFT].ground) / params.trackWidth; }
+  double busVoltage() const { return voltage; }
+
+  double x = 0;        // m
+  double y = 0;        // m
+  double heading = 0;  // rad, counter-clockwise
+  double distance = 0; // m travelled along the path
+
+  const PlantParams params;
+
+ private:
+  struct Wheel {
+    double omega = 0;   // rad/s
+    double ground = 0;  // m/s
+    double travel = 0;  // rad turned in either direction, for the encoder
+    uint32_t count = 0;
+    double current = 0; // A
+  };
+
+  void stepWheel(Wheel& wheel, bool inA, bool inB, uint16_t duty, double freeSpeed, double dt);
+  uint16_t pin(uint8_t p) const { return p < PIN_COUNT ? pins[p] : 0; }
+
+  uint16_t pins[PIN_COUNT] = {};
+  Wheel wheels[2];
+  double voltage;
+  uint32_t nowMs = 0;
+};
@@ -0,0 +1,112 @@
+#include "CommandRecorder.h"
+
+#include <string.h>
+
+namespace {
+
+uint8_t* put16(uint8_t* p, uint16_t value) {
+  *p++ = value & 0xFF;
+  *p++ = value >> 8;
+  return p;
+}
+
+uint16_t get16(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+}  // namespace
+
+size_t readRecord(const uint8_t* data, size_t length, LogRecord& out) {
+  if (length < RECORD_HEADER_SIZE) return 0;
+
+  out.timeMs = data[0] | (data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+  out.source = data[4];
+  out.client = data[5];
+  out.length = get16(data + 6);
+  out.changed = data[8];
+  out.state = {};
+
+  size_t size = RECORD_HEADER_SIZE + out.length;
+  if (out.changed & REC_FIELD_DIRECTION) size += 1;
+  if (out.changed & REC_FIELD_PWM_SPEED) size += 2;
+  if (out.changed & REC_FIELD_TURN_SPEED) size += 2;
+  if (out.changed & REC_FIELD_FLAGS) size += 1;
+  if (out.length > RECORD_MAX_PAYLOAD || size > length) return 0;
+
+  out.payload = data + RECORD_HEADER_SIZE;
+  const uint8_t* p = out.payload + out.length;
+  if (out.changed & REC_FIELD_DIRECTION) out.state.direction = *p++;
+  if (out.changed & REC_FIELD_PWM_SPEED) { out.state.pwmSpeed = get16(p); p += 2; }
+  if (out.changed & REC_FIELD_TURN_SPEED) { out.state.turnSpeed = get16(p); p += 2; }
+  if (out.changed & REC_FIELD_FLAGS) out.state.flags = *p++;
+  return size;
+}
+
+void CommandRecorder::record(uint32_t timeMs, uint8_t source, uint8_t client,
+                             const uint8_t* payload, size_t length,
+                             const RecordedState& before, const RecordedState& after) {
+  if (length > RECORD_MAX_PAYLOAD) {
+    length = RECORD_MAX_PAYLOAD;
+    source |= REC_TRUNCATED;
+  }
+
+  uint8_t changed = 0;
+  if (after.direction != before.direction) changed |= REC_FIELD_DIRECTION;
+  if (after.pwmSpeed != before.pwmSpeed) changed |= REC_FIELD_PWM_SPEED;
+  if (after.turnSpeed != before.turnSpeed) changed |= REC_FIELD_TURN_SPEED;
+  if (after.flags != before.flags) changed |= REC_FIELD_FLAGS;
+
+  uint8_t header[RECORD_HEADER_SIZE] = {
+    (uint8_t)timeMs, (uint8_t)(timeMs >> 8), (uint8_t)(timeMs >> 16), (uint8_t)(timeMs >> 24),
+    source, client, (uint8_t)length, (uint8_t)(length >> 8), changed
+  };
+  uint8_t fields[6];
+  uint8_t* p = fields;
+  if (changed & REC_FIELD_DIRECTION) *p++ = after.direction;
+  if (changed & REC_FIELD_PWM_SPEED) p = put16(p, after.pwmSpeed);
+  if (changed & REC_FIELD_TURN_SPEED) p = put16(p, after.turnSpeed);
+  if (changed & REC_FIELD_FLAGS) *p++ = after.flags;
+
+  size_t fieldSize = p - fields;
+  if (count + sizeof(header) + length + fieldSize > RING_SIZE) {
+    dropCount++;
+    return;
+  }
+
+  put(header, sizeof(header));
+  put(payload, length);
+  put(fields, fieldSize);
+  recordCount++;
+}
+
+void CommandRecorder::put(const uint8_t* data, size_t length) {
+  size_t tail = (head + count) % RING_SIZE;
+  size_t first = length < RING_SIZE - tail ? length : RING_SIZE - tail;
+  memcpy(ring + tail, data, first);
+  memcpy(ring, data + first, length - first);
+  count += length;
+}
+
+bool CommandRecorder::flushDue(uint32_t nowMs) const {
+  if (count == 0) return false;
+  return count >= FLUSH_THRESHOLD || nowMs - lastFlush >= FLUSH_INTERVAL_MS;
+}
+
+bool CommandRecorder::flush(RecordSink& sink, uint32_t nowMs) {
+  lastFlush = nowMs;
+  if (count == 0) return true;
+  if (!partial && !sink.begin(count)) return false;
+  while (count > 0) {
+    size_t chunk = count < RING_SIZE - head ? count : RING_SIZE - head;
+    size_t written = sink.write(ring + head, chunk);
+    if (written > chunk) written = chunk;
+    head = (head + written) % RING_SIZE;
+    count -= written;
+    if (written < chunk) {
+      partial = true;
+      return false;
+    }
+  }
+  partial = false;
+  return true;
+}
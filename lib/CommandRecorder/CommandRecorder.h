@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ===== Log Format =====
+// A log is RECORD_LOG_HEADER followed by records:
+//
+//   u32 timeMs   u8 source   u8 client   u16 length   u8 changed
+//   payload[length]
+//   then, in this order, only the fields flagged in `changed`:
+//   u8 direction   u16 pwmSpeed   u16 turnSpeed   u8 flags
+//
+// Multi-byte values are little endian. The fields describe the car state
+// right after the command was handled.
+inline constexpr uint8_t RECORD_LOG_HEADER[4] = { 'R', 'C', 'L', 1 };
+constexpr size_t RECORD_HEADER_SIZE = 9;
+constexpr size_t RECORD_MAX_PAYLOAD = 256;
+constexpr size_t RECORD_MAX_SIZE = RECORD_HEADER_SIZE + RECORD_MAX_PAYLOAD + 6;
+
+enum RecordSource : uint8_t {
+  REC_TEXT = 0,    // WebSocket text command
+  REC_BINARY = 1,  // WebSocket binary frame (script upload)
+  REC_IR = 2,      // IR code, 4 byte payload
+  REC_TRUNCATED = 0x80
+};
+
+enum RecordField : uint8_t {
+  REC_FIELD_DIRECTION = 0x01,
+  REC_FIELD_PWM_SPEED = 0x02,
+  REC_FIELD_TURN_SPEED = 0x04,
+  REC_FIELD_FLAGS = 0x08
+};
+
+enum RecordFlag : uint8_t {
+  REC_FLAG_HEADLIGHT = 0x01,
+  REC_FLAG_BRAKELIGHT = 0x02,
+  REC_FLAG_INDICATOR_LEFT = 0x04,
+  REC_FLAG_INDICATOR_RIGHT = 0x08,
+  REC_FLAG_HAZARD = 0x10,
+  REC_FLAG_GARAGE = 0x20,
+  REC_FLAG_HORN = 0x40,
+  REC_FLAG_MOVING = 0x80
+};
+
+// The recorded part of the car state
+struct RecordedState {
+  uint8_t direction;
+  uint16_t pwmSpeed;
+  uint16_t turnSpeed;
+  uint8_t flags;
+};
+
+struct LogRecord {
+  uint32_t timeMs;
+  uint8_t source;
+  uint8_t client;
+  uint16_t length;
+  uint8_t changed;
+  const uint8_t* payload;
+  RecordedState state;  // only fields flagged in `changed` are valid
+};
+
+// Parse the record at `data`. Returns the record size, or 0 when the
+// remaining bytes do not hold a complete record.
+size_t readRecord(const uint8_t* data, size_t length, LogRecord& out);
+
+// ===== Recorder =====
+// Where flushed batches go: LittleFS on the car, a file or memory on the host.
+class RecordSink {
+ public:
+  virtual ~RecordSink() {}
+  // Announces `length` bytes of whole records, which may then arrive in
+  // more than one write(); the place for a sink to rotate its file
+  virtual bool begin(size_t length) { (void)length; return true; }
+  // Returns how many bytes were written; fewer than `length` is a failure,
+  // and the rest is offered again on the next flush
+  virtual size_t write(const uint8_t* data, size_t length) = 0;
+};
+
+// Records are appended to a RAM ring buffer and written out in batches, so
+// command handling never waits on flash.
+class CommandRecorder {
+ public:
+  static constexpr size_t RING_SIZE = 2048;
+  static constexpr size_t FLUSH_THRESHOLD = 512;
+  static constexpr uint32_t FLUSH_INTERVAL_MS = 5000;
+
+  void record(uint32_t timeMs, uint8_t source, uint8_t client,
+              const uint8_t* payload, size_t length,
+              const RecordedState& before, const RecordedState& after);
+
+  bool flushDue(uint32_t nowMs) const;
+  // Write all pending bytes to `sink`. Returns false if the sink failed, in
+  // which case the bytes it did not take are kept for the next attempt.
+  bool flush(RecordSink& sink, uint32_t nowMs);
+
+  size_t pending() const { return count; }
+  uint32_t recorded() const { return recordCount; }
+  uint32_t dropped() const { return dropCount; }
+
+ private:
+  void put(const uint8_t* data, size_t length);
+
+  uint8_t ring[RING_SIZE];
+  size_t head = 0;   // next byte to flush
+  size_t count = 0;  // bytes pending
+  uint32_t lastFlush = 0;
+  bool partial = false;  // a failed flush left head inside a record
+  uint32_t recordCount = 0;
+  uint32_t dropCount = 0;
+};
@@ -0,0 +1,70 @@
+#include "LightSequencer.h"
+
+#include <string.h>
+
+const LightPattern* findLightEffect(const char* name) {
+  for (const LightEffect& effect : LIGHT_EFFECTS) {
+    if (strcmp(effect.name, name) == 0) return effect.pattern;
+  }
+  return nullptr;
+}
+
+int findLightChannel(const char* name) {
+  for (uint8_t ch = 0; ch < CH_COUNT; ch++) {
+    if (strcmp(LIGHT_CHANNEL_NAMES[ch], name) == 0) return ch;
+  }
+  return -1;
+}
+
+LightSequencer::LightSequencer() {
+  for (Channel& c : channels) {
+    c = { &PATTERN_OFF, 0, 1, 0, 0 };
+  }
+}
+
+uint16_t LightSequencer::stepLevel(const LightPattern& pattern, uint8_t step) {
+  if (pattern.levels) return pattern.levels[step];
+  return (pattern.bits >> step) & 1 ? LIGHT_LEVEL_MAX : 0;
+}
+
+void LightSequencer::play(uint8_t channel, const LightPattern& pattern, uint8_t stepTicks) {
+  if (channel >= CH_COUNT) return;
+
+  Channel& c = channels[channel];
+  c.pattern = &pattern;
+  c.step = 0;
+  c.stepTicks = stepTicks ? stepTicks : pattern.stepTicks;
+  c.tickInStep = 0;
+
+  uint16_t level = stepLevel(pattern, 0);
+  if (level != c.level) {
+    c.level = level;
+    changed |= 1 << channel;
+  }
+}
+
+uint8_t LightSequencer::tick() {
+  for (uint8_t ch = 0; ch < CH_COUNT; ch++) {
+    Channel& c = channels[ch];
+    if (++c.tickInStep < c.stepTicks) continue;
+
+    c.tickInStep = 0;
+    if (++c.step >= c.pattern->steps) {
+      c.step = 0;
+      if (!c.pattern->repeat) {
+        c.pattern = &PATTERN_OFF;
+        c.stepTicks = 1;
+      }
+    }
+
+    uint16_t level = stepLevel(*c.pattern, c.step);
+    if (level != c.level) {
+      c.level = level;
+      changed |= 1 << ch;
+    }
+  }
+
+  uint8_t mask = changed;
+  changed = 0;
+  return mask;
+}
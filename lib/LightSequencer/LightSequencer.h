@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdint.h>
+
+// ===== Timing =====
+constexpr uint16_t LIGHT_TICK_MS = 20;
+constexpr uint16_t LIGHT_LEVEL_MAX = 1023;
+
+constexpr uint8_t lightTicks(uint16_t ms) {
+  return ms < LIGHT_TICK_MS ? 1 : (ms / LIGHT_TICK_MS > 255 ? 255 : ms / LIGHT_TICK_MS);
+}
+
+// ===== Channels =====
+enum LightChannel : uint8_t {
+  CH_HEADLIGHT,
+  CH_BRAKELIGHT,
+  CH_INDICATOR_LEFT,
+  CH_INDICATOR_RIGHT,
+  CH_HORN,
+  CH_COUNT
+};
+
+// ===== Patterns =====
+// A pattern is a sequence of `steps` time slices of `stepTicks` ticks each.
+// Step n is on when bit n of `bits` is set, unless `levels` is given, in
+// which case it holds the PWM level of every step.
+struct LightPattern {
+  uint32_t bits;
+  const uint16_t* levels;
+  uint8_t steps;
+  uint8_t stepTicks;
+  bool repeat;
+};
+
+// Quadratic ramp up and down, 0..LIGHT_LEVEL_MAX
+inline constexpr uint16_t BREATHE_LEVELS[32] = {
+     0,    4,   16,   36,   64,  100,  144,  196,
+   256,  324,  400,  484,  576,  676,  784,  900,
+  1023,  900,  784,  676,  576,  484,  400,  324,
+   256,  196,  144,  100,   64,   36,   16,    4
+};
+
+inline constexpr LightPattern PATTERN_OFF          = { 0x0,  nullptr,        1, 1,                true  };
+inline constexpr LightPattern PATTERN_ON           = { 0x1,  nullptr,        1, 1,                true  };
+inline constexpr LightPattern PATTERN_BLINK        = { 0x1,  nullptr,        2, lightTicks(500),  true  };
+inline constexpr LightPattern PATTERN_DOUBLE_FLASH = { 0x5,  nullptr,       10, lightTicks(100),  true  };
+inline constexpr LightPattern PATTERN_STROBE       = { 0x1,  nullptr,        3, lightTicks(40),   true  };
+inline constexpr LightPattern PATTERN_BREATHE      = { 0x0,  BREATHE_LEVELS, 32, lightTicks(80),  true  };
+inline constexpr LightPattern PATTERN_BEEP         = { 0x1,  nullptr,        1, lightTicks(300),  false };
+inline constexpr LightPattern PATTERN_CHIRP        = { 0x15, nullptr,        5, lightTicks(60),   false };
+
+// Named effects selectable over WebSocket ("fx:<channel>:<effect>")
+struct LightEffect {
+  const char* name;
+  const LightPattern* pattern;
+};
+
+inline constexpr LightEffect LIGHT_EFFECTS[] = {
+  { "off",     &PATTERN_OFF },
+  { "on",      &PATTERN_ON },
+  { "blink",   &PATTERN_BLINK },
+  { "double",  &PATTERN_DOUBLE_FLASH },
+  { "strobe",  &PATTERN_STROBE },
+  { "breathe", &PATTERN_BREATHE },
+  { "beep",    &PATTERN_BEEP },
+  { "chirp",   &PATTERN_CHIRP },
+};
+
+inline constexpr const char* LIGHT_CHANNEL_NAMES[CH_COUNT] = {
+  "headlight", "brakelight", "indicator-left", "indicator-right", "horn"
+};
+
+const LightPattern* findLightEffect(const char* name);
+int findLightChannel(const char* name);
+
+// ===== Sequencer =====
+// Every channel advances by one step counter per tick, so the cost of a tick
+// is fixed regardless of which patterns are playing.
+class LightSequencer {
+ public:
+  LightSequencer();
+
+  // Start `pattern` on `channel` from its first step. A non-zero `stepTicks`
+  // overrides the pattern's own step length.
+  void play(uint8_t channel, const LightPattern& pattern, uint8_t stepTicks = 0);
+
+  // Advance all channels by one tick. Returns a bitmask of channels whose
+  // output level changed since the previous call.
+  uint8_t tick();
+
+  uint16_t level(uint8_t channel) const { return channels[channel].level; }
+  bool active(uint8_t channel) const {
+    const LightPattern* p = channels[channel].pattern;
+    return p->bits || p->levels;
+  }
+
+ private:
+  struct Channel {
+    const LightPattern* pattern;
+    uint8_t step;
+    uint8_t stepTicks;
+    uint8_t tickInStep;
+    uint16_t level;
+  };
+
+  static uint16_t stepLevel(const LightPattern& pattern, uint8_t step);
+
+  Channel channels[CH_COUNT];
+  uint8_t changed = 0;
+};
@@ -0,0 +1,199 @@
+#include "MotionScript.h"
+
+#include <string.h>
+
+namespace {
+
+constexpr uint8_t OP_SIZES[OP_COUNT] = {
+  1,  // END
+  5,  // DRIVE
+  3,  // WAIT
+  2,  // LIGHTS
+  2,  // HORN
+  2,  // LOOP
+  1,  // NEXT
+};
+
+uint16_t read16(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+bool validSpeed(uint8_t raw) {
+  int8_t value = (int8_t)raw;
+  return value >= -100 && value <= 100;
+}
+
+}  // namespace
+
+const char* scriptErrorName(ScriptError error) {
+  switch (error) {
+    case SCRIPT_OK: return "ok";
+    case SCRIPT_ERR_SIZE: return "size";
+    case SCRIPT_ERR_HEADER: return "header";
+    case SCRIPT_ERR_OPCODE: return "opcode";
+    case SCRIPT_ERR_TRUNCATED: return "truncated";
+    case SCRIPT_ERR_OPERAND: return "operand";
+    case SCRIPT_ERR_LOOP: return "loop";
+    case SCRIPT_ERR_END: return "end";
+    case SCRIPT_ERR_RUNAWAY: return "runaway";
+    case SCRIPT_ERR_ABORTED: return "aborted";
+  }
+  return "unknown";
+}
+
+uint8_t scriptOpSize(uint8_t op) {
+  return op < OP_COUNT ? OP_SIZES[op] : 0;
+}
+
+// ===== Validation =====
+ScriptError MotionScript::load(const uint8_t* data, size_t length, size_t* errorOffset) {
+  abort();
+  size = 0;
+
+  size_t offset = 0;
+  ScriptError result = SCRIPT_OK;
+  uint8_t loopDepth = 0;
+  bool ended = false;
+
+  if (length < SCRIPT_HEADER_SIZE + 1 || length > SCRIPT_MAX_SIZE) {
+    result = SCRIPT_ERR_SIZE;
+  } else if (data[0] != SCRIPT_MAGIC0 || data[1] != SCRIPT_MAGIC1 || data[2] != SCRIPT_VERSION) {
+    result = SCRIPT_ERR_HEADER;
+  } else {
+    offset = SCRIPT_HEADER_SIZE;
+    while (offset < length && result == SCRIPT_OK) {
+      const uint8_t op = data[offset];
+      const uint8_t opSize = scriptOpSize(op);
+
+      if (ended) { result = SCRIPT_ERR_END; break; }
+      if (opSize == 0) { result = SCRIPT_ERR_OPCODE; break; }
+      if (offset + opSize > length) { result = SCRIPT_ERR_TRUNCATED; break; }
+
+      const uint8_t* arg = data + offset + 1;
+      switch (op) {
+        case OP_END:
+          if (loopDepth != 0) result = SCRIPT_ERR_LOOP;
+          ended = true;
+          break;
+        case OP_DRIVE:
+          if (!validSpeed(arg[0]) || !validSpeed(arg[1])) result = SCRIPT_ERR_OPERAND;
+          break;
+        case OP_LIGHTS:
+          if (arg[0] & ~SCRIPT_LIGHT_ALL) result = SCRIPT_ERR_OPERAND;
+          break;
+        case OP_HORN:
+          if (arg[0] > SCRIPT_HORN_CHIRP) result = SCRIPT_ERR_OPERAND;
+          break;
+        case OP_LOOP:
+          if (++loopDepth > SCRIPT_MAX_LOOP_DEPTH) result = SCRIPT_ERR_LOOP;
+          break;
+        case OP_NEXT:
+          if (loopDepth-- == 0) result = SCRIPT_ERR_LOOP;
+          break;
+        default:
+          break;
+      }
+
+      if (result == SCRIPT_OK) offset += opSize;
+    }
+
+    if (result == SCRIPT_OK && !ended) result = SCRIPT_ERR_END;
+  }
+
+  error = result;
+  if (result != SCRIPT_OK) {
+    if (errorOffset) *errorOffset = offset;
+    return result;
+  }
+
+  memcpy(code, data, length);
+  size = length;
+  return SCRIPT_OK;
+}
+
+// ===== Execution =====
+bool MotionScript::start(MotionTarget& t) {
+  abort();
+  if (!loaded()) return false;
+
+  target = &t;
+  pc = SCRIPT_HEADER_SIZE;
+  depth = 0;
+  waitMs = 0;
+  elapsedMs = 0;
+  error = SCRIPT_OK;
+  tick(0);
+  return true;
+}
+
+void MotionScript::abort() {
+  if (running()) finish(SCRIPT_ERR_ABORTED);
+}
+
+void MotionScript::finish(ScriptError result) {
+  target->drive(0, 0);
+  target = nullptr;
+  error = result;
+}
+
+void MotionScript::tick(uint16_t dt) {
+  if (!running()) return;
+
+  elapsedMs += dt;
+  uint32_t budget = dt;
+  uint8_t ops = 0;
+
+  while (running()) {
+    if (waitMs > budget) {
+      waitMs -= budget;
+      return;
+    }
+    budget -= waitMs;
+    waitMs = 0;
+
+    // A loop without any wait would otherwise spin forever inside one tick
+    if (++ops > SCRIPT_MAX_OPS_PER_TICK) {
+      finish(SCRIPT_ERR_RUNAWAY);
+      return;
+    }
+    execute();
+  }
+}
+
+void MotionScript::execute() {
+  const uint8_t op = code[pc];
+  const uint8_t* arg = code + pc + 1;
+
+  switch (op) {
+    case OP_END:
+      finish(SCRIPT_OK);
+      return;
+    case OP_DRIVE:
+      target->drive((int8_t)arg[0], (int8_t)arg[1]);
+      waitMs = read16(arg + 2);
+      break;
+    case OP_WAIT:
+      waitMs = read16(arg);
+      break;
+    case OP_LIGHTS:
+      target->lights(arg[0]);
+      break;
+    case OP_HORN:
+      target->horn(arg[0]);
+      break;
+    case OP_LOOP:
+      loops[depth++] = { (uint16_t)(pc + OP_SIZES[OP_LOOP]), arg[0] };
+      break;
+    case OP_NEXT: {
+      Loop& loop = loops[depth - 1];
+      if (loop.remaining == 0 || --loop.remaining > 0) {
+        pc = loop.start;
+        return;
+      }
+      depth--;
+      break;
+    }
+  }
+
+  pc += OP_SIZES[op];
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ===== Bytecode =====
+// A script starts with SCRIPT_MAGIC0, SCRIPT_MAGIC1, SCRIPT_VERSION followed
+// by instructions. Multi-byte operands are little endian.
+//
+//   END                              stop motors, must be the last instruction
+//   DRIVE  left:i8 right:i8 ms:u16   set wheel speeds (-100..100 %), hold for ms
+//   WAIT   ms:u16                    hold current outputs for ms
+//   LIGHTS mask:u8                   set lights to SCRIPT_LIGHT_* mask
+//   HORN   effect:u8                 SCRIPT_HORN_BEEP or SCRIPT_HORN_CHIRP
+//   LOOP   count:u8                  repeat body up to NEXT, 0 = forever
+//   NEXT
+constexpr uint8_t SCRIPT_MAGIC0 = 'M';
+constexpr uint8_t SCRIPT_MAGIC1 = 'S';
+constexpr uint8_t SCRIPT_VERSION = 1;
+constexpr size_t SCRIPT_HEADER_SIZE = 3;
+constexpr size_t SCRIPT_MAX_SIZE = 256;
+constexpr uint8_t SCRIPT_MAX_LOOP_DEPTH = 4;
+constexpr uint8_t SCRIPT_MAX_OPS_PER_TICK = 64;
+
+enum ScriptOp : uint8_t {
+  OP_END = 0x00,
+  OP_DRIVE = 0x01,
+  OP_WAIT = 0x02,
+  OP_LIGHTS = 0x03,
+  OP_HORN = 0x04,
+  OP_LOOP = 0x05,
+  OP_NEXT = 0x06,
+  OP_COUNT
+};
+
+constexpr uint8_t SCRIPT_LIGHT_HEADLIGHT = 0x01;
+constexpr uint8_t SCRIPT_LIGHT_BRAKELIGHT = 0x02;
+constexpr uint8_t SCRIPT_LIGHT_LEFT = 0x04;
+constexpr uint8_t SCRIPT_LIGHT_RIGHT = 0x08;
+constexpr uint8_t SCRIPT_LIGHT_HAZARD = 0x10;
+constexpr uint8_t SCRIPT_LIGHT_ALL = 0x1F;
+
+constexpr uint8_t SCRIPT_HORN_BEEP = 0;
+constexpr uint8_t SCRIPT_HORN_CHIRP = 1;
+
+enum ScriptError : uint8_t {
+  SCRIPT_OK = 0,
+  SCRIPT_ERR_SIZE,
+  SCRIPT_ERR_HEADER,
+  SCRIPT_ERR_OPCODE,
+  SCRIPT_ERR_TRUNCATED,
+  SCRIPT_ERR_OPERAND,
+  SCRIPT_ERR_LOOP,
+  SCRIPT_ERR_END,
+  SCRIPT_ERR_RUNAWAY,
+  SCRIPT_ERR_ABORTED
+};
+
+const char* scriptErrorName(ScriptError error);
+uint8_t scriptOpSize(uint8_t op);
+
+// ===== Target =====
+// What a script drives. The firmware maps these onto the car, the native
+// build onto a recorder.
+class MotionTarget {
+ public:
+  virtual ~MotionTarget() {}
+  virtual void drive(int8_t left, int8_t right) = 0;
+  virtual void lights(uint8_t mask) = 0;
+  virtual void horn(uint8_t effect) = 0;
+};
+
+// ===== Interpreter =====
+// Time only advances through tick(), so a script produces the same output
+// sequence for the same tick length on the car and on the host.
+class MotionScript {
+ public:
+  // Validate and copy a script. A running script is aborted first.
+  ScriptError load(const uint8_t* code, size_t length, size_t* errorOffset = nullptr);
+
+  bool start(MotionTarget& target);
+  void abort();
+  void tick(uint16_t elapsedMs);
+
+  bool loaded() const { return size > 0; }
+  bool running() const { return target != nullptr; }
+  ScriptError lastError() const { return error; }
+  uint32_t elapsed() const { return elapsedMs; }
+
+ private:
+  struct Loop {
+    uint16_t start;
+    uint8_t remaining;
+  };
+
+  void finish(ScriptError result);
+  void execute();
+
+  uint8_t code[SCRIPT_MAX_SIZE];
+  size_t size = 0;
+  size_t pc = 0;
+  MotionTarget* target = nullptr;
+  Loop loops[SCRIPT_MAX_LOOP_DEPTH];
+  uint8_t depth = 0;
+  uint32_t waitMs = 0;
+  uint32_t elapsedMs = 0;
+  ScriptError error = SCRIPT_OK;
+};
@@ -0,0 +1,310 @@
+#include "OtaUpdate.h"
+
+#include <string.h>
+
+namespace {
+
+const uint32_t SHA256_K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+uint32_t ror(uint32_t x, int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+uint32_t read32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+}  // namespace
+
+const char* otaErrorName(OtaError error) {
+  switch (error) {
+    case OTA_OK: return "ok";
+    case OTA_ERR_HEADER: return "header";
+    case OTA_ERR_FORMAT: return "format";
+    case OTA_ERR_SOURCE: return "source";
+    case OTA_ERR_SPACE: return "space";
+    case OTA_ERR_OP: return "op";
+    case OTA_ERR_SIZE: return "size";
+    case OTA_ERR_TRUNCATED: return "truncated";
+    case OTA_ERR_HASH: return "hash";
+    case OTA_ERR_FLASH: return "flash";
+    case OTA_ERR_ABORTED: return "aborted";
+  }
+  return "unknown";
+}
+
+// ===== SHA-256 =====
+void Sha256::reset() {
+  const uint32_t initial[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+  memcpy(h, initial, sizeof(h));
+  buffered = 0;
+  total = 0;
+}
+
+void Sha256::block(const uint8_t* data) {
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++) {
+    w[i] = ((uint32_t)data[i * 4] << 24) | ((uint32_t)data[i * 4 + 1] << 16) |
+           ((uint32_t)data[i * 4 + 2] << 8) | data[i * 4 + 3];
+  }
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+  for (int i = 0; i < 64; i++) {
+    uint32_t t1 = k + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+    uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    k = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+  h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+
+void Sha256::update(const uint8_t* data, size_t length) {
+  total += length;
+  if (buffered > 0) {
+    size_t n = length < 64 - buffered ? length : 64 - buffered;
+    memcpy(buffer + buffered, data, n);
+    buffered += n;
+    data += n;
+    length -= n;
+    if (buffered < 64) return;
+    block(buffer);
+    buffered = 0;
+  }
+  for (; length >= 64; data += 64, length -= 64) block(data);
+  memcpy(buffer, data, length);
+  buffered = length;
+}
+
+void Sha256::finish(uint8_t digest[OTA_HASH_SIZE]) {
+  uint64_t bits = total * 8;
+  uint8_t pad[72] = { 0x80 };
+  size_t padLength = (buffered < 56 ? 56 : 120) - buffered;
+  for (int i = 0; i < 8; i++) pad[padLength + i] = (uint8_t)(bits >> (56 - i * 8));
+  update(pad, padLength + 8);
+
+  for (int i = 0; i < 32; i++) digest[i] = (uint8_t)(h[i / 4] >> (24 - (i % 4) * 8));
+  reset();
+}
+
+// ===== Receiver =====
+void OtaReceiver::begin() {
+  if (active()) target.abort();
+  stage = STAGE_HEADER;
+  failure = OTA_OK;
+  headerFill = 0;
+  expectedSize = 0;
+  operandFill = 0;
+  remaining = 0;
+  chunkFill = 0;
+  receivedBytes = 0;
+  writtenBytes = 0;
+  hash.reset();
+}
+
+void OtaReceiver::fail(OtaError error) {
+  // The target is open from the end of the header on
+  if (stage != STAGE_IDLE && stage != STAGE_HEADER) target.abort();
+  stage = STAGE_IDLE;
+  failure = error;
+}
+
+void OtaReceiver::abort() {
+  if (active()) fail(OTA_ERR_ABORTED);
+}
+
+bool OtaReceiver::startImage() {
+  if (memcmp(header, OTA_MAGIC, sizeof(OTA_MAGIC)) != 0 || header[3] == 0 || header[3] > OTA_VERSION) {
+    fail(OTA_ERR_HEADER);
+    return false;
+  }
+  if (header[4] >= OTA_FORMAT_COUNT) {
+    fail(OTA_ERR_FORMAT);
+    return false;
+  }
+
+  expectedSize = read32(header + 8);
+  if (expectedSize == 0) {
+    fail(OTA_ERR_HEADER);
+    return false;
+  }
+  if (header[4] == OTA_DELTA && read32(header + 12) != target.currentSize()) {
+    fail(OTA_ERR_SOURCE);
+    return false;
+  }
+  if (!target.begin(expectedSize)) {
+    fail(OTA_ERR_SPACE);
+    return false;
+  }
+
+  if (header[4] == OTA_DELTA) {
+    stage = STAGE_OPCODE;
+  } else {
+    stage = STAGE_DATA;
+    remaining = expectedSize;
+  }
+  return true;
+}
+
+bool OtaReceiver::flushChunk() {
+  if (chunkFill == 0) return true;
+  hash.update(chunk, chunkFill);
+  if (!target.write(chunk, chunkFill)) {
+    fail(OTA_ERR_FLASH);
+    return false;
+  }
+  writtenBytes += chunkFill;
+  chunkFill = 0;
+  return true;
+}
+
+bool OtaReceiver::busy() const {
+  return stage == STAGE_COPY;
+}
+
+size_t OtaReceiver::write(const uint8_t* data, size_t length) {
+  size_t used = consume(data, length);
+  receivedBytes += used;
+  return used;
+}
+
+size_t OtaReceiver::consume(const uint8_t* data, size_t length) {
+  size_t used = 0;
+  auto take = [&](size_t want) { return want < length - used ? want : length - used; };
+
+  while (stage != STAGE_IDLE) {
+    switch (stage) {
+      case STAGE_HEADER: {
+        size_t n = take(OTA_HEADER_SIZE - headerFill);
+        if (n == 0) return used;
+        memcpy(header + headerFill, data + used, n);
+        headerFill += n;
+        used += n;
+        if (headerFill == OTA_HEADER_SIZE && !startImage()) return length;
+        break;
+      }
+
+      case STAGE_OPCODE:
+        if (used == length) return used;
+        op = data[used++];
+        operandFill = 0;
+        if (op == OTA_OP_COPY) operandSize = 8;
+        else if (op == OTA_OP_DATA) operandSize = 2;
+        else {
+          fail(OTA_ERR_OP);
+          return length;
+        }
+        stage = STAGE_OPERANDS;
+        break;
+
+      case STAGE_OPERANDS: {
+        size_t n = take(operandSize - operandFill);
+        if (n == 0) return used;
+        memcpy(operands + operandFill, data + used, n);
+        operandFill += n;
+        used += n;
+        if (operandFill < operandSize) return used;
+
+        if (op == OTA_OP_COPY) {
+          copyOffset = read32(operands);
+          remaining = read32(operands + 4);
+          if (remaining == 0 || copyOffset > target.currentSize() ||
+              remaining > target.currentSize() - copyOffset) {
+            fail(OTA_ERR_OP);
+            return length;
+          }
+          stage = STAGE_COPY;
+        } else {
+          remaining = operands[0] | (operands[1] << 8);
+          if (remaining == 0) {
+            fail(OTA_ERR_OP);
+            return length;
+          }
+          stage = STAGE_DATA;
+        }
+        if (remaining > expectedSize - writtenBytes - chunkFill) {
+          fail(OTA_ERR_SIZE);
+          return length;
+        }
+        break;
+      }
+
+      case STAGE_DATA: {
+        size_t n = take(remaining < OTA_CHUNK_SIZE - chunkFill ? remaining : OTA_CHUNK_SIZE - chunkFill);
+        if (n == 0) return used;
+        memcpy(chunk + chunkFill, data + used, n);
+        chunkFill += n;
+        used += n;
+        remaining -= n;
+        if (remaining == 0) stage = format() == OTA_DELTA ? STAGE_OPCODE : STAGE_END;
+        if (chunkFill == OTA_CHUNK_SIZE) return flushChunk() ? used : length;
+        break;
+      }
+
+      case STAGE_COPY: {
+        size_t n = remaining < OTA_CHUNK_SIZE - chunkFill ? remaining : OTA_CHUNK_SIZE - chunkFill;
+        if (!target.readCurrent(copyOffset, chunk + chunkFill, n)) {
+          fail(OTA_ERR_FLASH);
+          return length;
+        }
+        chunkFill += n;
+        copyOffset += n;
+        remaining -= n;
+        if (remaining == 0) stage = STAGE_OPCODE;
+        if (chunkFill == OTA_CHUNK_SIZE) return flushChunk() ? used : length;
+        break;
+      }
+
+      case STAGE_END:
+        if (used == length) return used;
+        fail(OTA_ERR_SIZE);
+        return length;
+
+      case STAGE_IDLE:
+        break;
+    }
+  }
+  return length;
+}
+
+OtaError OtaReceiver::finish() {
+  if (stage == STAGE_IDLE) return failure == OTA_OK ? OTA_ERR_TRUNCATED : failure;
+
+  bool complete = (stage == STAGE_END || stage == STAGE_OPCODE) &&
+                  writtenBytes + chunkFill == expectedSize;
+  if (!complete) {
+    fail(OTA_ERR_TRUNCATED);
+    return failure;
+  }
+  if (!flushChunk()) return failure;
+
+  uint8_t digest[OTA_HASH_SIZE];
+  hash.finish(digest);
+  if (memcmp(digest, header + 16, OTA_HASH_SIZE) != 0) {
+    fail(OTA_ERR_HASH);
+    return failure;
+  }
+
+  if (!target.end()) {
+    fail(OTA_ERR_FLASH);
+    return failure;
+  }
+  stage = STAGE_IDLE;
+  failure = OTA_OK;
+  return OTA_OK;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ===== Package Format =====
+// An update is sent as one package:
+//
+//   'O' 'T' 'A' version:u8   format:u8   reserved:u8[3]
+//   imageSize:u32   sourceSize:u32   sha256:u8[32]
+//   body
+//
+// imageSize and sha256 describe the bytes that end up in flash. The body is
+// those bytes as they are for OTA_IMAGE and OTA_GZIP (a gzip-compressed
+// image, which the ESP8266 boot loader inflates while installing it), or a
+// delta against the running image for OTA_DELTA, which only applies when
+// the running image is sourceSize bytes long:
+//
+//   OTA_OP_COPY offset:u32 length:u32   bytes from the running image
+//   OTA_OP_DATA length:u16 bytes        new bytes
+//
+// Multi-byte values are little endian.
+inline constexpr uint8_t OTA_MAGIC[3] = { 'O', 'T', 'A' };
+constexpr uint8_t OTA_VERSION = 1;
+constexpr size_t OTA_HEADER_SIZE = 48;
+constexpr size_t OTA_HASH_SIZE = 32;
+
+// Output goes to the target in blocks of this size, the last one shorter
+constexpr size_t OTA_CHUNK_SIZE = 1024;
+
+enum OtaFormat : uint8_t {
+  OTA_IMAGE = 0,
+  OTA_GZIP = 1,
+  OTA_DELTA = 2,
+  OTA_FORMAT_COUNT
+};
+
+enum OtaOp : uint8_t {
+  OTA_OP_COPY = 0x01,
+  OTA_OP_DATA = 0x02
+};
+
+enum OtaError : uint8_t {
+  OTA_OK = 0,
+  OTA_ERR_HEADER,     // not a package, or a newer version
+  OTA_ERR_FORMAT,
+  OTA_ERR_SOURCE,     // delta made for a different running image
+  OTA_ERR_SPACE,      // target refused the image size
+  OTA_ERR_OP,         // malformed delta operation
+  OTA_ERR_SIZE,       // body produces more than imageSize bytes
+  OTA_ERR_TRUNCATED,  // body produced fewer than imageSize bytes
+  OTA_ERR_HASH,
+  OTA_ERR_FLASH,      // target read or write failed
+  OTA_ERR_ABORTED
+};
+
+const char* otaErrorName(OtaError error);
+
+// ===== SHA-256 =====
+class Sha256 {
+ public:
+  Sha256() { reset(); }
+  void reset();
+  void update(const uint8_t* data, size_t length);
+  void finish(uint8_t digest[OTA_HASH_SIZE]);
+
+ private:
+  void block(const uint8_t* data);
+
+  uint32_t h[8];
+  uint8_t buffer[64];
+  size_t buffered;
+  uint64_t total;
+};
+
+// ===== Target =====
+// Where the new image goes: the inactive flash region through the ESP8266
+// Updater on the car, memory on the host. Nothing is booted before end().
+class OtaTarget {
+ public:
+  virtual ~OtaTarget() {}
+  virtual bool begin(size_t imageSize) = 0;
+  virtual bool write(const uint8_t* data, size_t length) = 0;
+  // Commit: boot the new image from the next restart on
+  virtual bool end() = 0;
+  virtual void abort() = 0;
+  // The running image, which deltas copy from
+  virtual size_t currentSize() = 0;
+  virtual bool readCurrent(uint32_t offset, uint8_t* data, size_t length) = 0;
+};
+
+// ===== Receiver =====
+// Turns a package, fed in pieces of any size as it arrives, into the image
+// and hands it to the target in OTA_CHUNK_SIZE blocks. Only one chunk is
+// held in RAM. The hash is checked before the target is told to commit.
+class OtaReceiver {
+ public:
+  explicit OtaReceiver(OtaTarget& target) : target(target) {}
+
+  // Starts a new package, abandoning any unfinished one
+  void begin();
+
+  // Takes package bytes and returns how many it used. Each call writes at
+  // most one chunk, so a call can use fewer bytes than offered, or none
+  // when it spent its turn on a copy; call again with the rest, and with no
+  // bytes at all while busy() says a copy is still under way.
+  size_t write(const uint8_t* data, size_t length);
+  bool busy() const;
+
+  // After the last byte: checks size and hash and commits the image
+  OtaError finish();
+  void abort();
+
+  bool active() const { return stage != STAGE_IDLE; }
+  OtaError error() const { return failure; }
+  OtaFormat format() const { return (OtaFormat)header[4]; }
+  uint32_t imageSize() const { return expectedSize; }
+  uint32_t received() const { return receivedBytes; }
+  uint32_t written() const { return writtenBytes; }
+
+ private:
+  enum Stage : uint8_t { STAGE_IDLE, STAGE_HEADER, STAGE_OPCODE, STAGE_OPERANDS, STAGE_DATA, STAGE_COPY, STAGE_END };
+
+  bool startImage();
+  size_t consume(const uint8_t* data, size_t length);
+  bool flushChunk();
+  void fail(OtaError error);
+
+  OtaTarget& target;
+  Sha256 hash;
+
+  Stage stage = STAGE_IDLE;
+  OtaError failure = OTA_OK;
+  uint8_t header[OTA_HEADER_SIZE];
+  size_t headerFill = 0;
+  uint32_t expectedSize = 0;
+
+  uint8_t op = 0;
+  uint8_t operands[8];
+  size_t operandFill = 0;
+  size_t operandSize = 0;
+  uint32_t copyOffset = 0;
+  uint32_t remaining = 0;  // of the current DATA or COPY operation
+
+  uint8_t chunk[OTA_CHUNK_SIZE];
+  size_t chunkFill = 0;
+  uint32_t receivedBytes = 0;
+  uint32_t writtenBytes = 0;
+};
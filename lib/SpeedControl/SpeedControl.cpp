@@ -0,0 +1,48 @@
+#include "SpeedControl.h"
+
+void WheelSpeedMeter::reset(uint32_t count) {
+  for (uint32_t& h : history) h = count;
+  index = 0;
+}
+
+int32_t WheelSpeedMeter::update(uint32_t count, uint16_t tickMs) {
+  // history[index] is the oldest sample, WINDOW ticks back
+  uint32_t edges = count - history[index];
+  history[index] = count;
+  index = (index + 1) % WINDOW;
+  return (int32_t)(edges * 1000UL / ((uint32_t)tickMs * WINDOW));
+}
+
+void WheelPid::reset() {
+  integral = 0;
+  lastMeasured = 0;
+}
+
+uint16_t WheelPid::update(int32_t target, int32_t measured) {
+  if (target <= 0) {
+    reset();
+    return 0;
+  }
+
+  const int32_t error = target - measured;
+  const int32_t limit = (int32_t)outputMax << PID_SHIFT;
+
+  int32_t output = gains.kff * target + gains.kp * error
+                 - gains.kd * (measured - lastMeasured) + integral;
+  lastMeasured = measured;
+
+  // Anti-windup: only integrate while the output is not pushed against the
+  // limit in the direction the error would drive it further
+  bool saturatedHigh = output >= limit && error > 0;
+  bool saturatedLow = output <= 0 && error < 0;
+  if (!saturatedHigh && !saturatedLow) {
+    integral += gains.ki * error;
+    if (integral > limit) integral = limit;
+    if (integral < -limit) integral = -limit;
+  }
+
+  output >>= PID_SHIFT;
+  if (output < 0) return 0;
+  if (output > outputMax) return outputMax;
+  return (uint16_t)output;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+// ===== Fixed Point =====
+// Gains are Q10: 1024 == 1.0. Speeds are encoder counts per second, outputs
+// PWM duty.
+constexpr uint8_t PID_SHIFT = 10;
+constexpr int32_t PID_ONE = 1 << PID_SHIFT;
+
+struct PidGains {
+  int32_t kff;  // duty per count/s of target, open-loop estimate
+  int32_t kp;   // duty per count/s of error
+  int32_t ki;   // duty per count/s of error, accumulated every update
+  int32_t kd;   // duty per count/s change of the measurement per update
+};
+
+// ===== Speed Meter =====
+// Speed from a free-running edge counter, averaged over the last WINDOW
+// updates so a low-resolution encoder still gives a usable reading.
+class WheelSpeedMeter {
+ public:
+  static constexpr uint8_t WINDOW = 4;
+
+  void reset(uint32_t count);
+  // Feed the counter once per control tick. Returns counts per second.
+  int32_t update(uint32_t count, uint16_t tickMs);
+
+ private:
+  uint32_t history[WINDOW] = {};
+  uint8_t index = 0;
+};
+
+// ===== PID =====
+// Magnitude controller: target and measurement are >= 0, the bridge inputs
+// set the direction.
+class WheelPid {
+ public:
+  explicit WheelPid(const PidGains& gains, uint16_t outputMax)
+    : gains(gains), outputMax(outputMax) {}
+
+  void reset();
+  uint16_t update(int32_t target, int32_t measured);
+
+  PidGains gains;
+
+ private:
+  int32_t integral = 0;  // Q10 duty
+  int32_t lastMeasured = 0;
+  uint16_t outputMax;
+};
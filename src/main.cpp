@@ -6,10 +6,14 @@
 #include <IRremoteESP8266.h>
 #include <IRrecv.h>
 #include <IRutils.h>
+#include <LittleFS.h>
+#include <Updater.h>
+#include <CarCore.h>
+#include <OtaUpdate.h>
 
-// ===== Configuration =====
-#define DEBUG_MODE true
+#include <new>
 
+// ===== Configuration =====
 #if DEBUG_MODE
   #define DEBUG_PRINT(x) Serial.print(x)
   #define DEBUG_PRINTLN(x) Serial.println(x)
@@ -18,62 +22,303 @@
   #define DEBUG_PRINTLN(x)
 #endif
 
-// ===== Pin Definitions =====
-constexpr uint8_t ENA = 5;   // D1
-constexpr uint8_t ENB = 4;   // D2
-constexpr uint8_t IN1 = 0;   // D3
-constexpr uint8_t IN2 = 2;   // D4
-constexpr uint8_t IN3 = 14;  // D5
-constexpr uint8_t IN4 = 12;  // D6
-constexpr uint8_t HEADLIGHT_PIN = 13;   // D7
-constexpr uint8_t BRAKELIGHT_PIN = 15;  // D8
-constexpr uint8_t INDICATOR_LEFT = 16;  // D0
-constexpr uint8_t INDICATOR_RIGHT = 3;  // RX
-constexpr uint8_t HORN_PIN = 1;         // TX
-constexpr uint8_t IR_RECV_PIN = 10;     // SD3
-
-// ===== Constants =====
-constexpr uint16_t WS_RECONNECT_INTERVAL = 2000;
-constexpr uint16_t INDICATOR_INTERVAL = 500;
-constexpr uint16_t HORN_DURATION = 300;
-constexpr uint16_t HEARTBEAT_INTERVAL = 30000;
-constexpr uint16_t DEBOUNCE_DELAY = 200;
+constexpr const char* LOG_PATH = "/rec.bin";
+constexpr const char* LOG_OLD_PATH = "/rec.old";
+constexpr size_t LOG_MAX_SIZE = 64 * 1024;
+
+// Firmware upload buffer; more than the TCP receive window, see serviceOta()
+constexpr size_t OTA_QUEUE_SIZE = 8192;
+constexpr uint8_t OTA_CHUNKS_PER_LOOP = 4;
+constexpr uint32_t OTA_RESTART_DELAY_MS = 500;
+constexpr uint32_t OTA_STALL_TIMEOUT_MS = 5000;
+constexpr const char* OTA_CONTENT_TYPE = "application/octet-stream";
 
 // ===== Objects =====
 IRrecv irrecv(IR_RECV_PIN);
 decode_results results;
 AsyncWebServer server(80);
 WebSocketsServer webSocket(81);
+CommandRecorder recorder;
+
+// ===== Boot Timing =====
+// Microseconds since reset at each setup() milestone, served on /boot
+struct BootTimes {
+  uint32_t start;
+  uint32_t motorsSafe;
+  uint32_t configLoaded;
+  uint32_t apUp;
+  uint32_t driveReady;
+  ConfigError config;
+  bool apRestarted;
+};
+BootTimes bootTimes;
 
-// ===== WiFi Config =====
-const char* ssid = "🚘 Nabil Remote Car 🚘"; 
-const char* password = "123456789";
-IPAddress local_IP(192,168,10,1);
-IPAddress gateway(192,168,10,1);
-IPAddress subnet(255,255,255,0);
-
-// ===== Car State =====
-struct CarState {
-  int pwmSpeed = 800;
-  int turnSpeed = 600;
-  bool isMoving = false;
-  String currentDirection = "stop";
-  
-  bool headlightState = false;
-  bool brakelightState = false;
-  bool indicatorLeftState = false;
-  bool indicatorRightState = false;
-  bool hazardLightsState = false;
-  bool garageMode = false;
-  bool hornActive = false;
-  
-  unsigned long lastIndicatorToggle = 0;
-  unsigned long lastHornOn = 0;
-  unsigned long lastHeartbeat = 0;
-  unsigned long lastIRCommand = 0;
+// ===== Wheel Encoders =====
+#if WHEEL_ENCODERS
+volatile uint32_t encoderPulses[2] = {0, 0};
+
+void IRAM_ATTR onLeftEncoder() { encoderPulses[WHEEL_LEFT]++; }
+void IRAM_ATTR onRightEncoder() { encoderPulses[WHEEL_RIGHT]++; }
+#endif
+
+// ===== Board Bindings =====
+class ArduinoHal : public CarHal {
+ public:
+  void pinWrite(uint8_t pin, bool level) override { digitalWrite(pin, level ? HIGH : LOW); }
+  void pwmWrite(uint8_t pin, uint16_t duty) override { analogWrite(pin, duty); }
+  uint32_t millis() override { return ::millis(); }
+#if WHEEL_ENCODERS
+  bool hasEncoders() override { return true; }
+  uint32_t encoderCount(uint8_t side) override { return encoderPulses[side]; }
+#endif
+  void log(const char* message) override { Serial.println(message); }
+};
+
+class WebSocketLink : public CarLink {
+ public:
+  void send(uint8_t client, const char* text, size_t length) override {
+    webSocket.sendTXT(client, text, length);
+  }
+  void broadcast(const char* text, size_t length) override {
+    webSocket.broadcastTXT(text, length);
+  }
+  uint8_t clientCount() override { return webSocket.connectedClients(); }
+};
+
+// The config block has the sector the EEPROM library would use, between the
+// sketch and the filesystem, to itself: one flash read at boot, and neither
+// filesystem formats nor sketch uploads touch it
+extern "C" uint32_t _EEPROM_start;
+
+class FlashConfigStore : public ConfigStore {
+ public:
+  bool read(uint8_t* block) override {
+    return ESP.flashRead(address(), (uint32_t*)block, CONFIG_BLOCK_SIZE);
+  }
+  bool write(const uint8_t* block) override {
+    return ESP.flashEraseSector(address() / SPI_FLASH_SEC_SIZE) &&
+           ESP.flashWrite(address(), (const uint32_t*)block, CONFIG_BLOCK_SIZE);
+  }
+
+ private:
+  static uint32_t address() { return (uint32_t)((uintptr_t)&_EEPROM_start - 0x40200000); }
+};
+
+// Appends recorder batches to LittleFS, keeping one rotated older log.
+// Rotation happens once per batch, before its first byte, so no record is
+// split between the two files.
+class LittleFsSink : public RecordSink {
+ public:
+  bool begin(size_t length) override {
+    File file = LittleFS.open(LOG_PATH, "a");
+    if (!file) return false;
+    bool full = file.size() + length > LOG_MAX_SIZE;
+    file.close();
+
+    if (full) {
+      LittleFS.remove(LOG_OLD_PATH);
+      LittleFS.rename(LOG_PATH, LOG_OLD_PATH);
+    }
+    return true;
+  }
+
+  size_t write(const uint8_t* data, size_t length) override {
+    File file = LittleFS.open(LOG_PATH, "a");
+    if (!file) return 0;
+
+    // A short header would leave the file unreadable; start it over
+    if (file.size() == 0 &&
+        file.write(RECORD_LOG_HEADER, sizeof(RECORD_LOG_HEADER)) != sizeof(RECORD_LOG_HEADER)) {
+      file.close();
+      LittleFS.remove(LOG_PATH);
+      return 0;
+    }
+    size_t written = file.write(data, length);
+    file.close();
+    return written;
+  }
+};
+
+ArduinoHal boardHal;
+WebSocketLink wsLink;
+LittleFsSink logSink;
+bool logMounted = false;  // without it records stay in RAM and are dropped once it fills
+FlashConfigStore configStore;
+Car car(boardHal, wsLink, &recorder, &configStore);
+
+// ===== Firmware Update =====
+// The Updater writes to the free space after the running sketch and only
+// has the boot loader copy it over on the next restart once end() succeeds
+class UpdaterTarget : public OtaTarget {
+ public:
+  bool begin(size_t imageSize) override { return Update.begin(imageSize); }
+  bool write(const uint8_t* data, size_t length) override {
+    return Update.write(const_cast<uint8_t*>(data), length) == length;
+  }
+  bool end() override { return Update.end(); }
+  // The Updater has no abort; an MD5 that cannot match makes end() drop
+  // the image without committing it
+  void abort() override {
+    Update.setMD5("00000000000000000000000000000000");
+    Update.end(true);
+  }
+  size_t currentSize() override { return ESP.getSketchSize(); }
+  bool readCurrent(uint32_t offset, uint8_t* data, size_t length) override {
+    return ESP.flashRead(offset, data, length);
+  }
 };
 
-CarState car;
+// One upload at a time. The body arrives in TCP callbacks, which must not
+// spend long on flash, so it is only queued there and applied from loop().
+UpdaterTarget updateTarget;
+
+struct OtaSession {
+  explicit OtaSession(AsyncWebServerRequest* request) : request(request), receiver(updateTarget) {}
+
+  AsyncWebServerRequest* request;
+  OtaReceiver receiver;
+  uint8_t queue[OTA_QUEUE_SIZE];
+  size_t head = 0;
+  size_t fill = 0;
+  uint32_t lastDataMs = 0;
+  bool bodyDone = false;
+};
+
+OtaSession* otaSession = nullptr;
+AsyncWebServerRequest* otaAnswered = nullptr;  // answered early, until it disconnects
+const char* otaRefused = nullptr;
+uint32_t otaRestartAt = 0;
+
+void endOtaSession(bool installed) {
+  delete otaSession;
+  otaSession = nullptr;
+  if (installed) otaRestartAt = millis() + OTA_RESTART_DELAY_MS;
+  else car.lockMotors(false);
+}
+
+// Answers before the body is in and closes the connection instead of
+// reading the rest; body callbacks may still arrive until it is closed
+void answerOtaEarly(AsyncWebServerRequest* request, int code, const char* text) {
+  otaAnswered = request;
+  request->onDisconnect([request]() {
+    if (otaAnswered == request) otaAnswered = nullptr;
+  });
+  request->send(code, "text/plain", text);
+  request->client()->close();
+}
+
+void failOtaSession(int code, const char* text) {
+  AsyncWebServerRequest* request = otaSession->request;
+  otaSession->receiver.abort();
+  endOtaSession(false);
+  answerOtaEarly(request, code, text);
+}
+
+// Body callback. Packets are acknowledged only as loop() applies them, so
+// the sender never has more than a TCP window outstanding and the queue,
+// which is larger, cannot overflow.
+void handleOtaBody(AsyncWebServerRequest* request, uint8_t* data, size_t length, size_t index, size_t) {
+  if (request == otaAnswered) return;
+  if (index == 0 && !otaSession) {
+    otaSession = new (std::nothrow) OtaSession(request);
+    if (!otaSession) {
+      otaRefused = "error:memory";
+      return;
+    }
+    otaRefused = nullptr;
+    car.lockMotors(true);
+    otaSession->receiver.begin();
+    request->onDisconnect([request]() {
+      if (otaSession && otaSession->request == request) {
+        otaSession->receiver.abort();
+        endOtaSession(false);
+      }
+    });
+  }
+  if (!otaSession || otaSession->request != request) return;
+
+  if (length > OTA_QUEUE_SIZE - otaSession->fill) {
+    otaSession->receiver.abort();  // the sender ignored flow control
+    return;
+  }
+  request->client()->ackLater();
+  for (size_t i = 0; i < length; i++) {
+    otaSession->queue[(otaSession->head + otaSession->fill + i) % OTA_QUEUE_SIZE] = data[i];
+  }
+  otaSession->fill += length;
+  otaSession->lastDataMs = millis();
+}
+
+void handleOtaRequest(AsyncWebServerRequest* request) {
+  if (request == otaAnswered) return;
+  if (otaSession && otaSession->request == request) {
+    otaSession->bodyDone = true;  // answered from serviceOta()
+  } else if (otaSession) {
+    request->send(409, "text/plain", "error:busy");
+  } else {
+    request->send(400, "text/plain", otaRefused ? otaRefused : "error:empty");
+    otaRefused = nullptr;
+  }
+}
+
+// POST /update with any other body type, which the /update handler's
+// filter leaves to this one. A form-encoded body would be parsed into
+// parameters on the heap for a handler with a request callback; this one
+// is trivial, so the server drops the body unread and it answers at the end.
+class OtaTypeRefusal : public AsyncWebHandler {
+ public:
+  bool canHandle(AsyncWebServerRequest* request) override {
+    return request->method() == HTTP_POST && request->url() == "/update";
+  }
+  void handleRequest(AsyncWebServerRequest* request) override {
+    request->send(415, "text/plain", "error:type");
+  }
+  bool isRequestHandlerTrivial() override { return true; }
+};
+
+OtaTypeRefusal otaTypeRefusal;
+
+// Feeds queued bytes to the receiver, a few chunks per pass so the loop
+// keeps serving the watchdog, and answers once the body is applied. A
+// package that fails, or a sender that goes quiet, is answered at once.
+void serviceOta() {
+  if (otaRestartAt && (int32_t)(millis() - otaRestartAt) >= 0) ESP.restart();
+  if (!otaSession) return;
+
+  OtaSession& session = *otaSession;
+  size_t applied = 0;
+  for (uint8_t i = 0; i < OTA_CHUNKS_PER_LOOP && session.receiver.active(); i++) {
+    size_t run = min(session.fill, OTA_QUEUE_SIZE - session.head);
+    if (run == 0 && !session.receiver.busy()) break;
+    size_t used = session.receiver.write(session.queue + session.head, run);
+    session.head = (session.head + used) % OTA_QUEUE_SIZE;
+    session.fill -= used;
+    applied += used;
+  }
+  if (applied > 0) session.request->client()->ack(applied);
+
+  if (!session.receiver.active()) {
+    char text[32];
+    snprintf(text, sizeof(text), "error:%s", otaErrorName(session.receiver.error()));
+    failOtaSession(400, text);
+    return;
+  }
+  if (session.fill > 0 || session.receiver.busy()) return;
+  if (!session.bodyDone) {
+    if (millis() - session.lastDataMs >= OTA_STALL_TIMEOUT_MS) failOtaSession(408, "error:timeout");
+    return;
+  }
+
+  OtaError error = session.receiver.finish();
+  char text[32];
+  if (error == OTA_OK) {
+    snprintf(text, sizeof(text), "ok:%lu", (unsigned long)session.receiver.written());
+  } else {
+    snprintf(text, sizeof(text), "error:%s", otaErrorName(error));
+  }
+  session.request->send(error == OTA_OK ? 200 : 400, "text/plain", text);
+  endOtaSession(error == OTA_OK);
+}
 
 // ===== HTML Page =====
 const char index_html[] PROGMEM = R"rawliteral(
@@ -353,20 +598,94 @@ const char index_html[] PROGMEM = R"rawliteral(
     let lastCommandTime = 0;
     const COMMAND_DEBOUNCE = 100; // ms
 
+    // Logging is off unless the page is opened with ?debug
+    const DEBUG = new URLSearchParams(location.search).has('debug');
+    const log = DEBUG ? console.log.bind(console) : () => {};
+
     function haptic(ms=20) { 
       if(navigator.vibrate) navigator.vibrate(ms); 
     }
 
+    // ===== View =====
+    // Messages and local input only record what the page should show;
+    // once per animation frame, fields that differ from what is on screen
+    // are written out, so a burst of identical state messages costs no DOM
+    // work at all.
+    const DIRECTION_ARROWS = { forward: '↑', backward: '↓', left: '←', right: '→' };
+    const TOGGLE_IDS = {
+      headlight: 'headlight-toggle',
+      brakelight: 'brakelight-toggle',
+      indicatorLeft: 'indicator-left-toggle',
+      indicatorRight: 'indicator-right-toggle'
+    };
+
+    const el = {};        // element references, looked up once
+    const shown = {};     // field values currently on screen
+    const pending = {};   // field values for the next frame
+    let frameRequested = false;
+
+    function cacheElements() {
+      ['direction', 'speed-value', 'speed', 'connection-dot', 'connection-status', 'connection-loader']
+        .forEach(id => el[id] = document.getElementById(id));
+      for (const key in TOGGLE_IDS) {
+        const toggle = document.getElementById(TOGGLE_IDS[key]);
+        el[key] = { toggle, input: toggle.querySelector('input') };
+        el[key].input.dataset.view = key;
+      }
+    }
+
+    const RENDER = {
+      direction(arrow) {
+        el.direction.textContent = arrow;
+      },
+      speed(value) {
+        el['speed-value'].textContent = '⚡ ' + value + '%';
+        el.speed.value = value;
+        el.speed.style.background =
+          `linear-gradient(to right, #27ae60 ${value}%, #555 ${value}%)`;
+      },
+      loader(show) {
+        el['connection-loader'].style.display = show ? 'inline-block' : 'none';
+        el['connection-dot'].style.display = show ? 'none' : 'inline-block';
+      },
+      connection(status) {
+        el['connection-dot'].className = 'status-dot ' + (status === 'Connected' ? 'connected' : 'disconnected');
+        el['connection-status'].textContent = status;
+      }
+    };
+    for (const key in TOGGLE_IDS) {
+      RENDER[key] = (on) => {
+        el[key].toggle.classList.toggle('active', on);
+        el[key].input.checked = on;
+      };
+    }
+
+    function setView(key, value) {
+      pending[key] = value;
+      if (!frameRequested) {
+        frameRequested = true;
+        requestAnimationFrame(commitView);
+      }
+    }
+
+    function commitView() {
+      frameRequested = false;
+      for (const key in pending) {
+        const value = pending[key];
+        delete pending[key];
+        if (shown[key] === value) continue;
+        shown[key] = value;
+        RENDER[key](value);
+      }
+    }
+
     function showLoader(show) {
-      const loader = document.getElementById('connection-loader');
-      const dot = document.getElementById('connection-dot');
-      loader.style.display = show ? 'inline-block' : 'none';
-      dot.style.display = show ? 'none' : 'inline-block';
+      setView('loader', show);
     }
 
     function initWebSocket() {
       showLoader(true);
-      document.getElementById('connection-status').textContent = 'Connecting...';
+      setView('connection', 'Connecting...');
       
       clearTimeout(reconnectTimeout);
       
@@ -376,7 +695,7 @@ const char index_html[] PROGMEM = R"rawliteral(
         websocket.onopen = () => {
           updateConnectionStatus(true);
           showLoader(false);
-          console.log('WebSocket connected');
+          log('WebSocket connected');
           // Request current state
           setTimeout(() => websocket.send('getState'), 100);
         };
@@ -384,7 +703,7 @@ const char index_html[] PROGMEM = R"rawliteral(
         websocket.onclose = () => {
           updateConnectionStatus(false);
           showLoader(true);
-          console.log('WebSocket disconnected, reconnecting...');
+          log('WebSocket disconnected, reconnecting...');
           reconnectTimeout = setTimeout(initWebSocket, 2000);
         };
         
@@ -395,13 +714,13 @@ const char index_html[] PROGMEM = R"rawliteral(
         
         websocket.onmessage = (event) => {
           const message = event.data;
-          console.log('Received:', message);
+          log('Received:', message);
           
           if (message.startsWith('state:')) {
             handleStateMessage(message);
           } else if (message === 'heartbeat') {
             // Heartbeat received, connection is alive
-            console.log('Heartbeat received');
+            log('Heartbeat received');
           }
         };
         
@@ -414,11 +733,7 @@ const char index_html[] PROGMEM = R"rawliteral(
 
     function updateConnectionStatus(connected) {
       isConnected = connected;
-      const dot = document.getElementById('connection-dot');
-      const status = document.getElementById('connection-status');
-      
-      dot.className = 'status-dot ' + (connected ? 'connected' : 'disconnected');
-      status.textContent = connected ? 'Connected' : 'Disconnected';
+      setView('connection', connected ? 'Connected' : 'Disconnected');
       
       if (!connected) {
         showLoader(true);
@@ -435,7 +750,7 @@ const char index_html[] PROGMEM = R"rawliteral(
       if (isConnected && websocket.readyState === WebSocket.OPEN) {
         try {
           websocket.send(cmd);
-          console.log("Sent:", cmd);
+          log("Sent:", cmd);
           haptic(15);
         } catch (error) {
           console.error('Send error:', error);
@@ -443,7 +758,7 @@ const char index_html[] PROGMEM = R"rawliteral(
           initWebSocket();
         }
       } else {
-        console.warn('Not connected, command not sent:', cmd);
+        log('Not connected, command not sent:', cmd);
         updateConnectionStatus(false);
         initWebSocket();
       }
@@ -456,67 +771,23 @@ const char index_html[] PROGMEM = R"rawliteral(
       states.forEach(state => {
         const [key, value] = state.split(':');
         
-        switch(key) {
-          case 'direction':
-            document.getElementById('direction').textContent = 
-              value === 'forward' ? '↑' : 
-              value === 'backward' ? '↓' : 
-              value === 'left' ? '←' : 
-              value === 'right' ? '→' : '⏹';
-            break;
-            
-          case 'speed':
-            const speedValue = parseInt(value);
-            document.getElementById('speed-value').textContent = '⚡ ' + speedValue + '%';
-            document.getElementById('speed').value = speedValue;
-            const percent = (speedValue / 100) * 100;
-            document.getElementById('speed').style.background = 
-              `linear-gradient(to right, #27ae60 ${percent}%, #555 ${percent}%)`;
-            break;
-            
-          case 'headlight':
-            updateToggle('headlight-toggle', value === 'on');
-            break;
-            
-          case 'brakelight':
-            updateToggle('brakelight-toggle', value === 'on');
-            break;
-            
-          case 'indicatorLeft':
-            updateToggle('indicator-left-toggle', value === 'on');
-            break;
-            
-          case 'indicatorRight':
-            updateToggle('indicator-right-toggle', value === 'on');
-            break;
-            
-          case 'hazard':
-            // Handle hazard lights if needed
-            break;
+        if (key === 'direction') {
+          setView('direction', DIRECTION_ARROWS[value] || '⏹');
+        } else if (key === 'speed') {
+          setView('speed', parseInt(value));
+        } else if (key in TOGGLE_IDS) {
+          setView(key, value === 'on');
         }
+        // hazard and script are not shown
       });
     }
 
-    function updateToggle(toggleId, isOn) {
-      const toggle = document.getElementById(toggleId);
-      const input = toggle.querySelector('input');
-      
-      if (isOn) {
-        toggle.classList.add('active');
-        input.checked = true;
-      } else {
-        toggle.classList.remove('active');
-        input.checked = false;
-      }
-    }
-
     function addHoldButton(btn, cmd, label) {
-      const dirText = document.getElementById('direction');
       let holdInterval;
       
       const start = () => {
         sendCommand(cmd);
-        dirText.textContent = label;
+        setView('direction', label);
         
         // Continue sending command while held
         holdInterval = setInterval(() => {
@@ -527,7 +798,7 @@ const char index_html[] PROGMEM = R"rawliteral(
       const stop = () => {
         clearInterval(holdInterval);
         sendCommand("stop");
-        dirText.textContent = "⏹";
+        setView('direction', "⏹");
       };
       
       // Touch events
@@ -545,7 +816,8 @@ const char index_html[] PROGMEM = R"rawliteral(
     }
 
     window.onload = () => {
-      console.log('Initializing RC Car controller...');
+      log('Initializing RC Car controller...');
+      cacheElements();
       
       // Initialize WebSocket
       initWebSocket();
@@ -558,23 +830,22 @@ const char index_html[] PROGMEM = R"rawliteral(
       
       document.querySelector('[data-cmd="stop"]').addEventListener('click', () => {
         sendCommand("stop");
-        document.getElementById("direction").textContent = "⏹";
+        setView('direction', "⏹");
       });
       
       // Speed slider
-      const speedSlider = document.getElementById("speed");
-      speedSlider.addEventListener('input', (e) => {
-        const value = e.target.value;
-        document.getElementById("speed-value").textContent = "⚡ " + value + "%";
+      el.speed.addEventListener('input', (e) => {
+        const value = parseInt(e.target.value);
         sendCommand("speed:" + value);
-        const percent = (value / 100) * 100;
-        speedSlider.style.background = 
-          `linear-gradient(to right, #27ae60 ${percent}%, #555 ${percent}%)`;
+        setView('speed', value);
       });
       
       // Feature toggles
       document.querySelectorAll(".feature-controls input").forEach(toggle => {
         toggle.addEventListener('change', () => {
+          // The box already shows the new value; make sure the car's next
+          // state message is written back even if it matches the old one
+          if (toggle.dataset.view) delete shown[toggle.dataset.view];
           const cmd = toggle.dataset.cmd + (toggle.checked ? ":on" : ":off");
           sendCommand(cmd);
         });
@@ -609,48 +880,27 @@ const char index_html[] PROGMEM = R"rawliteral(
 </html>
 )rawliteral";
 
-// ===== Function Prototypes =====
-void handleWebSocketCommand(uint8_t num, const String& command);
-void handleIRCommand(unsigned long value);
-void setSpeed(int speedPercent);
-void moveForward();
-void moveBackward();
-void turnLeft();
-void turnRight();
-void stopMotors();
-void toggleHeadlight();
-void toggleBrakelight();
-void toggleLeftIndicator();
-void toggleRightIndicator();
-void toggleHazardLights();
-void soundHorn();
-void toggleGarageMode();
-void handleIndicators();
-void handleHorn();
-void sendHeartbeat();
-void applyMotor(int in1, int in2, int in3, int in4, int ena, int enb);
-void updateClientState(uint8_t num);
-void broadcastState();
-
 // ===== WebSocket Event =====
 void webSocketEvent(uint8_t num, WStype_t type, uint8_t * payload, size_t length) {
   switch(type) {
     case WStype_DISCONNECTED:
       DEBUG_PRINTLN("[" + String(num) + "] Disconnected!");
+      car.onClientEvent(num, CLIENT_DISCONNECTED, payload, length);
       break;
       
     case WStype_CONNECTED: {
         IPAddress ip = webSocket.remoteIP(num);
         DEBUG_PRINTLN("[" + String(num) + "] Connected from " + ip.toString());
-        updateClientState(num);
+        car.onClientEvent(num, CLIENT_CONNECTED, payload, length);
       }
       break;
       
     case WStype_TEXT:
-      if(length > 0) {
-        String message = String((char*)payload);
-        handleWebSocketCommand(num, message);
-      }
+      car.onClientEvent(num, CLIENT_TEXT, payload, length);
+      break;
+      
+    case WStype_BIN:
+      car.onClientEvent(num, CLIENT_BINARY, payload, length);
       break;
       
     case WStype_PING:
@@ -665,278 +915,140 @@ void webSocketEvent(uint8_t num, WStype_t type, uint8_t * payload, size_t length
   }
 }
 
-// ===== Command Handler =====
-void handleWebSocketCommand(uint8_t num, const String& command) {
-  DEBUG_PRINTLN("Received command: " + command);
-  
-  if (command == "forward") moveForward();
-  else if (command == "backward") moveBackward();
-  else if (command == "left") turnLeft();
-  else if (command == "right") turnRight();
-  else if (command == "stop") stopMotors();
-  else if (command.startsWith("speed:")) setSpeed(command.substring(6).toInt());
-  else if (command == "headlight:on") { if (!car.headlightState) toggleHeadlight(); }
-  else if (command == "headlight:off") { if (car.headlightState) toggleHeadlight(); }
-  else if (command == "brakelight:on") { if (!car.brakelightState) toggleBrakelight(); }
-  else if (command == "brakelight:off") { if (car.brakelightState) toggleBrakelight(); }
-  else if (command == "indicator-left:on") { if (!car.indicatorLeftState) toggleLeftIndicator(); }
-  else if (command == "indicator-left:off") { if (car.indicatorLeftState) toggleLeftIndicator(); }
-  else if (command == "indicator-right:on") { if (!car.indicatorRightState) toggleRightIndicator(); }
-  else if (command == "indicator-right:off") { if (car.indicatorRightState) toggleRightIndicator(); }
-  else if (command == "hazard:on") { if (!car.hazardLightsState) toggleHazardLights(); }
-  else if (command == "hazard:off") { if (car.hazardLightsState) toggleHazardLights(); }
-  else if (command == "horn") soundHorn();
-  else if (command == "garage") toggleGarageMode();
-  else if (command == "getState") updateClientState(num);
-  else if (command == "ping") webSocket.sendTXT(num, "pong");
-  
-  // Broadcast state changes to all clients
-  broadcastState();
-}
+// ===== Access Point =====
+// The SDK keeps the last soft-AP settings in its own flash area and brings
+// the AP up from them before setup() runs, so the AP is only restarted when
+// the config asks for something else.
+bool startAccessPoint(const CarConfig& config) {
+  IPAddress ip(config.apIp[0], config.apIp[1], config.apIp[2], config.apIp[3]);
+  IPAddress subnet(255,255,255,0);
 
-// ===== IR Remote Handler =====
-void handleIRCommand(unsigned long value) {
-  unsigned long now = millis();
-  if (now - car.lastIRCommand < DEBOUNCE_DELAY) return;
-  
-  car.lastIRCommand = now;
-  
-  DEBUG_PRINT("IR Command: 0x");
-  DEBUG_PRINTLN(String(value, HEX));
-  
-  switch(value) {
-    case 0xFFA25D: stopMotors(); break;
-    case 0xFF629D: moveForward(); break;
-    case 0xFFA857: moveBackward(); break;
-    case 0xFF22DD: turnLeft(); break;
-    case 0xFFC23D: turnRight(); break;
-    case 0xFF02FD: toggleHeadlight(); break;
-    case 0xFFE01F: toggleBrakelight(); break;
-    case 0xFF906F: toggleLeftIndicator(); break;
-    case 0xFF6897: toggleRightIndicator(); break;
-    case 0xFF9867: toggleHazardLights(); break;
-    case 0xFFB04F: soundHorn(); break;
-    case 0xFF30CF: toggleGarageMode(); break;
-    default: DEBUG_PRINTLN("Unknown IR command");
-  }
-  
-  broadcastState();
-}
-
-// ===== Motor Control =====
-void applyMotor(int in1, int in2, int in3, int in4, int ena, int enb) {
-  digitalWrite(IN1, in1); digitalWrite(IN2, in2);
-  digitalWrite(IN3, in3); digitalWrite(IN4, in4);
-  analogWrite(ENA, ena); analogWrite(ENB, enb);
-}
-
-void setSpeed(int speedPercent) {
-  car.pwmSpeed = map(speedPercent, 0, 100, 0, 1023);
-  car.turnSpeed = map(speedPercent, 0, 100, 0, 800);
-  
-  // Update current movement with new speed
-  if (car.currentDirection == "forward") moveForward();
-  else if (car.currentDirection == "backward") moveBackward();
-  else if (car.currentDirection == "left") turnLeft();
-  else if (car.currentDirection == "right") turnRight();
-}
-
-void moveForward() {
-  applyMotor(HIGH, LOW, HIGH, LOW, car.pwmSpeed, car.pwmSpeed);
-  car.currentDirection = "forward";
-  car.isMoving = true;
-  if (car.brakelightState) toggleBrakelight();
-}
-
-void moveBackward() {
-  applyMotor(LOW, HIGH, LOW, HIGH, car.pwmSpeed, car.pwmSpeed);
-  car.currentDirection = "backward";
-  car.isMoving = true;
-  if (!car.brakelightState) toggleBrakelight();
-}
-
-void turnLeft() {
-  applyMotor(HIGH, LOW, LOW, HIGH, car.turnSpeed, car.turnSpeed);
-  car.currentDirection = "left";
-  car.isMoving = true;
-  if (!car.indicatorLeftState && !car.hazardLightsState) toggleLeftIndicator();
-}
-
-void turnRight() {
-  applyMotor(LOW, HIGH, HIGH, LOW, car.turnSpeed, car.turnSpeed);
-  car.currentDirection = "right";
-  car.isMoving = true;
-  if (!car.indicatorRightState && !car.hazardLightsState) toggleRightIndicator();
-}
-
-void stopMotors() {
-  applyMotor(LOW, LOW, LOW, LOW, 0, 0);
-  car.currentDirection = "stop";
-  car.isMoving = false;
-  if (!car.brakelightState) toggleBrakelight();
-  if (car.indicatorLeftState && !car.hazardLightsState) toggleLeftIndicator();
-  if (car.indicatorRightState && !car.hazardLightsState) toggleRightIndicator();
-}
-
-// ===== Feature Control =====
-void toggleHeadlight() {
-  car.headlightState = !car.headlightState;
-  digitalWrite(HEADLIGHT_PIN, car.headlightState);
-}
-
-void toggleBrakelight() {
-  car.brakelightState = !car.brakelightState;
-  digitalWrite(BRAKELIGHT_PIN, car.brakelightState);
-}
-
-void toggleLeftIndicator() {
-  car.indicatorLeftState = !car.indicatorLeftState;
-  if (car.hazardLightsState) car.hazardLightsState = false;
-}
-
-void toggleRightIndicator() {
-  car.indicatorRightState = !car.indicatorRightState;
-  if (car.hazardLightsState) car.hazardLightsState = false;
-}
-
-void toggleHazardLights() {
-  car.hazardLightsState = !car.hazardLightsState;
-  car.indicatorLeftState = false;
-  car.indicatorRightState = false;
-}
-
-void soundHorn() {
-  digitalWrite(HORN_PIN, HIGH);
-  car.hornActive = true;
-  car.lastHornOn = millis();
-}
+  WiFi.setSleepMode(WIFI_NONE_SLEEP);
+  WiFi.setAutoReconnect(true);
 
-void toggleGarageMode() {
-  car.garageMode = !car.garageMode;
-  if (car.garageMode) {
-    setSpeed(30);
-    if (!car.headlightState) toggleHeadlight();
-  } else {
-    setSpeed(80);
-  }
-}
+  bool running = (WiFi.getMode() & WIFI_AP) &&
+                 WiFi.softAPSSID() == config.apSsid &&
+                 WiFi.softAPPSK() == config.apPassword &&
+                 WiFi.channel() == config.apChannel;
 
-// ===== Indicator and Horn Handling =====
-void handleIndicators() {
-  unsigned long now = millis();
-  if (now - car.lastIndicatorToggle >= INDICATOR_INTERVAL) {
-    car.lastIndicatorToggle = now;
-    
-    if (car.hazardLightsState) {
-      digitalWrite(INDICATOR_LEFT, !digitalRead(INDICATOR_LEFT));
-      digitalWrite(INDICATOR_RIGHT, !digitalRead(INDICATOR_RIGHT));
-    } else if (car.indicatorLeftState) {
-      digitalWrite(INDICATOR_LEFT, !digitalRead(INDICATOR_LEFT));
-      digitalWrite(INDICATOR_RIGHT, LOW);
-    } else if (car.indicatorRightState) {
-      digitalWrite(INDICATOR_RIGHT, !digitalRead(INDICATOR_RIGHT));
-      digitalWrite(INDICATOR_LEFT, LOW);
-    } else {
-      digitalWrite(INDICATOR_LEFT, LOW);
-      digitalWrite(INDICATOR_RIGHT, LOW);
-    }
+  // The AP address is not among the saved settings; setting it only
+  // restarts the DHCP server
+  if (WiFi.softAPIP() != ip && !WiFi.softAPConfig(ip, ip, subnet)) {
+    DEBUG_PRINTLN("AP Config Failed!");
   }
-}
+  if (running) return false;
 
-void handleHorn() {
-  if (car.hornActive && millis() - car.lastHornOn >= HORN_DURATION) {
-    digitalWrite(HORN_PIN, LOW);
-    car.hornActive = false;
+  if (WiFi.softAP(config.apSsid, config.apPassword, config.apChannel)) {
+    DEBUG_PRINT("AP IP: ");
+    DEBUG_PRINTLN(WiFi.softAPIP());
+  } else {
+    DEBUG_PRINTLN("AP Failed to start!");
   }
+  return true;
 }
 
-// ===== State Management =====
-void updateClientState(uint8_t num) {
-  String state = "state:";
-  state += "direction:" + car.currentDirection + ",";
-  state += "speed:" + String(map(car.pwmSpeed, 0, 1023, 0, 100)) + ",";
-  state += "headlight:" + String(car.headlightState ? "on" : "off") + ",";
-  state += "brakelight:" + String(car.brakelightState ? "on" : "off") + ",";
-  state += "indicatorLeft:" + String(car.indicatorLeftState ? "on" : "off") + ",";
-  state += "indicatorRight:" + String(car.indicatorRightState ? "on" : "off") + ",";
-  state += "hazard:" + String(car.hazardLightsState ? "on" : "off");
-  
-  webSocket.sendTXT(num, state);
-}
-
-void broadcastState() {
-  for (uint8_t i = 0; i < webSocket.connectedClients(); i++) {
-    updateClientState(i);
-  }
-}
+// ===== Setup =====
+void setup() {
+  bootTimes.start = micros();
 
-void sendHeartbeat() {
-  unsigned long now = millis();
-  if (now - car.lastHeartbeat >= HEARTBEAT_INTERVAL) {
-    car.lastHeartbeat = now;
-    webSocket.broadcastTXT("heartbeat");
+  // The bridge inputs float until their pins are outputs, so the motors
+  // are stopped before anything else
+  for (uint8_t pin : MOTOR_PINS) {
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, LOW);
   }
-}
+  bootTimes.motorsSafe = micros();
 
-// ===== Setup =====
-void setup() {
   Serial.begin(115200);
   DEBUG_PRINTLN("ESP8266 RC Car Starting...");
 
   // Initialize pins
-  const uint8_t pins[] = {ENA, ENB, IN1, IN2, IN3, IN4, 
-                         HEADLIGHT_PIN, BRAKELIGHT_PIN, 
-                         INDICATOR_LEFT, INDICATOR_RIGHT, HORN_PIN};
-  
-  for (uint8_t pin : pins) {
+  for (uint8_t pin : OUTPUT_PINS) {
     pinMode(pin, OUTPUT);
     digitalWrite(pin, LOW);
   }
   
-  stopMotors();
-
+  // One flash read; the defaults stay in place if it is missing or damaged
+  bootTimes.config = loadConfig(configStore, car.config);
+  bootTimes.configLoaded = micros();
+  car.begin();
+
+#if WHEEL_ENCODERS
+  // Encoders take over SD3 from the IR receiver
+  pinMode(ENCODER_LEFT_PIN, INPUT_PULLUP);
+  pinMode(ENCODER_RIGHT_PIN, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(ENCODER_LEFT_PIN), onLeftEncoder, RISING);
+  attachInterrupt(digitalPinToInterrupt(ENCODER_RIGHT_PIN), onRightEncoder, RISING);
+#else
   // Initialize IR receiver
   irrecv.enableIRIn();
+#endif
 
-  // Configure WiFi
-  WiFi.setSleepMode(WIFI_NONE_SLEEP);
-  WiFi.setAutoReconnect(true);
-  
-  if (!WiFi.softAPConfig(local_IP, gateway, subnet)) {
-    DEBUG_PRINTLN("AP Config Failed!");
-  }
-  
-  if (WiFi.softAP(ssid, password)) {
-    DEBUG_PRINT("AP IP: ");
-    DEBUG_PRINTLN(WiFi.softAPIP());
-  } else {
-    DEBUG_PRINTLN("AP Failed to start!");
-  }
+  bootTimes.apRestarted = startAccessPoint(car.config);
+  bootTimes.apUp = micros();
 
   // Start server
   server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){ 
     request->send(200, "text/html", index_html); 
   });
   
+  // Command log, flushed at most FLUSH_INTERVAL_MS ago
+  server.on("/log", HTTP_GET, [](AsyncWebServerRequest *request){
+    if (!LittleFS.exists(LOG_PATH)) {
+      request->send(404);
+      return;
+    }
+    request->send(LittleFS, LOG_PATH, "application/octet-stream", true);
+  });
+  
+  // Boot milestones in microseconds since reset
+  server.on("/boot", HTTP_GET, [](AsyncWebServerRequest *request){
+    char text[160];
+    snprintf(text, sizeof(text),
+             "start=%lu,motors_safe=%lu,config_loaded=%lu,ap_up=%lu,drive_ready=%lu,config=%s,ap=%s",
+             (unsigned long)bootTimes.start, (unsigned long)bootTimes.motorsSafe,
+             (unsigned long)bootTimes.configLoaded, (unsigned long)bootTimes.apUp,
+             (unsigned long)bootTimes.driveReady, configErrorName(bootTimes.config),
+             bootTimes.apRestarted ? "restarted" : "kept");
+    request->send(200, "text/plain", text);
+  });
+  
+  // Firmware package, see OtaUpdate.h; the car restarts into it on success
+  server.on("/update", HTTP_POST, handleOtaRequest, nullptr, handleOtaBody)
+    .setFilter([](AsyncWebServerRequest* request) { return request->contentType() == OTA_CONTENT_TYPE; });
+  server.addHandler(&otaTypeRefusal);
+  
   server.begin();
   webSocket.begin();
   webSocket.onEvent(webSocketEvent);
+  bootTimes.driveReady = micros();
 
   DEBUG_PRINTLN("Server + WebSocket started");
+
+  // Only the command log needs the filesystem, and mounting it is the
+  // slowest step left, so it comes after the car is ready to drive
+  logMounted = LittleFS.begin();
+  if (!logMounted) {
+    DEBUG_PRINTLN("LittleFS mount failed, command log not saved");
+  }
 }
 
 // ===== Main Loop =====
 void loop() {
   webSocket.loop();
   
+#if !WHEEL_ENCODERS
   if (irrecv.decode(&results)) {
-    handleIRCommand(results.value);
+    car.dispatchIR(results.value);
     irrecv.resume();
   }
+#endif
+  
+  car.handleControlTick();
+  car.sendHeartbeat();
   
-  handleIndicators();
-  handleHorn();
-  sendHeartbeat();
+  if (logMounted && recorder.flushDue(millis())) recorder.flush(logSink, millis());
+  serviceOta();
   
   // Small delay to prevent watchdog timer issues
   delay(10);
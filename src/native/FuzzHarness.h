@@ -0,0 +1,273 @@
+#pragma once
+
+// Shared parts of the fuzz targets: a HAL that traps out-of-range PWM, the
+// invariant check run after every input event, and a standalone driver for
+// compilers without libFuzzer.
+//
+// With clang, build a target with -fsanitize=fuzzer,address,undefined and
+// run it as any libFuzzer binary (or under AFL++ via afl-clang-fast++). With
+// -DFUZZ_STANDALONE the driver below provides main(): it replays corpus
+// files, then mutates them, and when also built with
+// -fsanitize-coverage=trace-pc keeps the inputs that reach new code.
+
+#include <CarCore.h>
+
+#include "HostBindings.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+class FuzzHal : public HostHal {
+ public:
+  void pwmWrite(uint8_t pin, uint16_t duty) override {
+    if (duty > PWM_MAX) {
+      fprintf(stderr, "pwmWrite(%u, %u) is outside 0..%u\n", pin, duty, PWM_MAX);
+      abort();
+    }
+    HostHal::pwmWrite(pin, duty);
+  }
+};
+
+inline void fuzzCheck(bool ok, const char* what) {
+  if (!ok) {
+    fprintf(stderr, "invariant broken: %s\n", what);
+    abort();
+  }
+}
+
+// Every duty the car can reach must be a valid 10-bit PWM value
+inline void checkInvariants(const Car& car, const FuzzHal& hal) {
+  fuzzCheck(car.state.pwmSpeed >= 0 && car.state.pwmSpeed <= PWM_MAX, "pwmSpeed in 0..PWM_MAX");
+  fuzzCheck(car.state.turnSpeed >= 0 && car.state.turnSpeed <= PWM_MAX, "turnSpeed in 0..PWM_MAX");
+  for (uint16_t target : car.state.motorTarget) fuzzCheck(target <= PWM_MAX, "motorTarget in 0..PWM_MAX");
+  for (uint16_t level : hal.pins) fuzzCheck(level <= PWM_MAX, "pin level in 0..PWM_MAX");
+}
+
+// Frames reach the handlers in an exactly sized heap block, so AddressSanitizer
+// reports any read past `length`
+inline std::vector<uint8_t> exactCopy(const uint8_t* data, size_t length) {
+  return std::vector<uint8_t>(data, data + length);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+#ifdef FUZZ_STANDALONE
+
+#include <dirent.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <random>
+#include <string>
+
+// ===== Coverage =====
+namespace {
+
+constexpr size_t COVERAGE_SIZE = 1 << 16;
+uint8_t coverage[COVERAGE_SIZE];
+uint16_t touched[COVERAGE_SIZE];  // edges hit by the current input
+size_t touchedCount = 0;
+uintptr_t previousPc = 0;
+
+}  // namespace
+
+// Called by -fsanitize-coverage=trace-pc at every basic block; records edges
+// the way AFL does
+extern "C" __attribute__((no_sanitize_coverage)) void __sanitizer_cov_trace_pc() {
+  uintptr_t pc = (uintptr_t)__builtin_return_address(0);
+  size_t edge = (pc ^ previousPc) & (COVERAGE_SIZE - 1);
+  if (!coverage[edge]) {
+    coverage[edge] = 1;
+    touched[touchedCount++] = (uint16_t)edge;
+  }
+  previousPc = pc >> 1;
+}
+
+namespace {
+
+using Input = std::vector<uint8_t>;
+
+std::vector<uint8_t> seen(COVERAGE_SIZE);
+const Input* current = nullptr;
+
+// Saves the input that was running when a check or a sanitizer fired
+void saveCrash() {
+  if (!current) return;
+  FILE* file = fopen("crash-input", "wb");
+  if (!file) return;
+  fwrite(current->data(), 1, current->size(), file);
+  fclose(file);
+  fprintf(stderr, "input saved to crash-input (%zu bytes)\n", current->size());
+  current = nullptr;
+}
+
+void onAbort(int) {
+  saveCrash();
+  _exit(1);
+}
+
+bool readFile(const std::string& path, Input& out) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) return false;
+  out.clear();
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) out.insert(out.end(), buffer, buffer + n);
+  fclose(file);
+  return true;
+}
+
+void loadCorpus(const char* path, std::vector<Input>& corpus) {
+  struct stat info;
+  if (stat(path, &info) != 0) return;
+
+  Input input;
+  if (!S_ISDIR(info.st_mode)) {
+    if (readFile(path, input)) corpus.push_back(input);
+    return;
+  }
+
+  DIR* dir = opendir(path);
+  while (dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] == '.') continue;
+    if (readFile(std::string(path) + "/" + entry->d_name, input)) corpus.push_back(input);
+  }
+  closedir(dir);
+}
+
+// Forgets edges hit outside the target, e.g. by the mutator itself
+void clearCoverage() {
+  for (size_t i = 0; i < touchedCount; i++) coverage[touched[i]] = 0;
+  touchedCount = 0;
+  previousPc = 0;
+}
+
+// Runs one input; true if it reached an edge no earlier input reached
+bool runInput(const Input& input) {
+  clearCoverage();
+  current = &input;
+  LLVMFuzzerTestOneInput(input.data(), input.size());
+  current = nullptr;
+
+  bool fresh = false;
+  for (size_t i = 0; i < touchedCount; i++) {
+    if (!seen[touched[i]]) {
+      seen[touched[i]] = 1;
+      fresh = true;
+    }
+  }
+  clearCoverage();
+  return fresh;
+}
+
+Input mutate(const std::vector<Input>& corpus, std::mt19937& rng, size_t maxSize) {
+  auto pick = [&](size_t n) { return (size_t)std::uniform_int_distribution<size_t>(0, n - 1)(rng); };
+  Input input = corpus[pick(corpus.size())];
+
+  for (int rounds = 1 + (int)pick(4); rounds > 0; rounds--) {
+    switch (pick(6)) {
+      case 0:  // flip a bit
+        if (!input.empty()) input[pick(input.size())] ^= 1 << pick(8);
+        break;
+      case 1:  // random byte
+        if (!input.empty()) input[pick(input.size())] = (uint8_t)rng();
+        break;
+      case 2:  // insert a byte
+        input.insert(input.begin() + pick(input.size() + 1), (uint8_t)rng());
+        break;
+      case 3:  // erase a run
+        if (!input.empty()) {
+          size_t at = pick(input.size());
+          input.erase(input.begin() + at, input.begin() + at + 1 + pick(input.size() - at));
+        }
+        break;
+      case 4: {  // splice in part of another input
+        const Input& other = corpus[pick(corpus.size())];
+        if (other.empty()) break;
+        size_t from = pick(other.size());
+        size_t length = 1 + pick(other.size() - from);
+        input.insert(input.begin() + pick(input.size() + 1),
+                     other.begin() + from, other.begin() + from + length);
+        break;
+      }
+      case 5:  // interesting byte values
+        if (!input.empty()) {
+          static const uint8_t VALUES[] = { 0, 1, 0x7F, 0x80, 0xFF, '-', '0', '9', ':' };
+          input[pick(input.size())] = VALUES[pick(sizeof(VALUES))];
+        }
+        break;
+    }
+  }
+  if (input.size() > maxSize) input.resize(maxSize);
+  return input;
+}
+
+void writeInput(const char* dir, const Input& input, size_t index) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/input-%06zu", dir, index);
+  FILE* file = fopen(path, "wb");
+  if (!file) return;
+  fwrite(input.data(), 1, input.size(), file);
+  fclose(file);
+}
+
+}  // namespace
+
+extern "C" void __sanitizer_set_death_callback(void (*callback)()) __attribute__((weak));
+
+int main(int argc, char** argv) {
+  signal(SIGABRT, onAbort);
+  if (__sanitizer_set_death_callback) __sanitizer_set_death_callback(saveCrash);
+
+  long iterations = 0;
+  unsigned seed = 1;
+  size_t maxSize = 1024;
+  const char* outDir = nullptr;
+  std::vector<Input> corpus;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) iterations = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) seed = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-m") && i + 1 < argc) maxSize = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc) outDir = argv[++i];
+    else if (argv[i][0] == '-') {
+      fprintf(stderr, "usage: %s [-n iterations] [-s seed] [-m max_size] [-o new_inputs_dir] corpus...\n", argv[0]);
+      return 2;
+    }
+    else loadCorpus(argv[i], corpus);
+  }
+  if (corpus.empty()) corpus.push_back(Input());
+
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+
+  size_t edges = 0;
+  for (const Input& input : corpus) runInput(input);
+  for (uint8_t s : seen) edges += s;
+  printf("replayed=%zu edges=%zu\n", corpus.size(), edges);
+
+  std::mt19937 rng(seed);
+  size_t found = 0;
+  for (long i = 0; i < iterations; i++) {
+    Input input = mutate(corpus, rng, maxSize);
+    if (runInput(input)) {
+      corpus.push_back(input);
+      if (outDir) writeInput(outDir, input, found);
+      found++;
+    }
+  }
+
+  edges = 0;
+  for (uint8_t s : seen) edges += s;
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  printf("runs=%ld new_inputs=%zu edges=%zu exec_per_s=%.0f\n",
+         (long)corpus.size() - (long)found + iterations, found, edges,
+         (corpus.size() - found + iterations) / seconds);
+  return 0;
+}
+
+#endif
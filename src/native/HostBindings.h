@@ -0,0 +1,129 @@
+#pragma once
+
+// CarHal and CarLink for running the car logic on a host: a virtual clock
+// that only moves when the caller advances it, and a link that counts what
+// would have been sent. HostConfigStore and HostOtaTarget stand in for the
+// flash the config block and an update are written to.
+
+#include <CarCore.h>
+#include <OtaUpdate.h>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+class HostHal : public CarHal {
+ public:
+  void pinWrite(uint8_t pin, bool level) override {
+    if (pin < PIN_COUNT) pins[pin] = level ? PWM_MAX : 0;
+    writes++;
+  }
+
+  void pwmWrite(uint8_t pin, uint16_t duty) override {
+    if (pin < PIN_COUNT) pins[pin] = duty;
+    writes++;
+  }
+
+  uint32_t millis() override { return now; }
+
+  void log(const char* message) override {
+    if (verbose) printf("[%8u] %s\n", (unsigned)now, message);
+  }
+
+  static constexpr uint8_t PIN_COUNT = 17;
+
+  uint32_t now = 0;
+  uint32_t writes = 0;
+  uint16_t pins[PIN_COUNT] = {};
+  bool verbose = false;
+};
+
+class HostLink : public CarLink {
+ public:
+  void send(uint8_t client, const char* text, size_t length) override {
+    (void)client; (void)text;
+    messages++;
+    bytes += length;
+  }
+
+  void broadcast(const char* text, size_t length) override {
+    (void)text;
+    messages += clients;
+    bytes += length * clients;
+  }
+
+  uint8_t clientCount() override { return clients; }
+
+  uint8_t clients = 0;
+  uint32_t messages = 0;
+  uint64_t bytes = 0;
+};
+
+// The config sector, in memory; erased until something is written
+class HostConfigStore : public ConfigStore {
+ public:
+  HostConfigStore() { erase(); }
+
+  bool read(uint8_t* out) override {
+    memcpy(out, block, CONFIG_BLOCK_SIZE);
+    return true;
+  }
+
+  bool write(const uint8_t* in) override {
+    memcpy(block, in, CONFIG_BLOCK_SIZE);
+    writes++;
+    return true;
+  }
+
+  void erase() { memset(block, 0xFF, sizeof(block)); }
+
+  uint8_t block[CONFIG_BLOCK_SIZE];
+  uint32_t writes = 0;
+};
+
+// The running image and the update region, in memory
+class HostOtaTarget : public OtaTarget {
+ public:
+  bool begin(size_t imageSize) override {
+    if (imageSize > capacity) return false;
+    image.clear();
+    expected = imageSize;
+    open = true;
+    return true;
+  }
+
+  bool write(const uint8_t* data, size_t length) override {
+    if (!open || image.size() + length > expected) return false;
+    image.insert(image.end(), data, data + length);
+    writes++;
+    return true;
+  }
+
+  bool end() override {
+    if (!open || image.size() != expected) return false;
+    open = false;
+    committed = true;
+    return true;
+  }
+
+  void abort() override {
+    open = false;
+    image.clear();
+  }
+
+  size_t currentSize() override { return current.size(); }
+
+  bool readCurrent(uint32_t offset, uint8_t* data, size_t length) override {
+    if (offset > current.size() || length > current.size() - offset) return false;
+    memcpy(data, current.data() + offset, length);
+    return true;
+  }
+
+  std::vector<uint8_t> current;
+  std::vector<uint8_t> image;
+  size_t capacity = 1 << 20;  // free sketch space on a 4 MB NodeMCU
+  size_t expected = 0;
+  uint32_t writes = 0;
+  bool open = false;
+  bool committed = false;
+};
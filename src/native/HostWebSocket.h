@@ -0,0 +1,168 @@
+#pragma once
+
+// Just enough of RFC 6455 for the loopback server and the load generator:
+// the upgrade handshake and single-fragment text, ping, pong and close
+// frames. No extensions, no fragmentation.
+
+#include <stdint.h>
+
+#include <cstring>
+#include <string>
+
+enum WsOpcode : uint8_t {
+  WS_OP_TEXT = 0x1,
+  WS_OP_BINARY = 0x2,
+  WS_OP_CLOSE = 0x8,
+  WS_OP_PING = 0x9,
+  WS_OP_PONG = 0xA
+};
+
+// Largest frame either side accepts; the car's messages are all far smaller
+constexpr size_t WS_MAX_PAYLOAD = 1024;
+constexpr size_t WS_MAX_HEADER = 14;
+
+// ===== Handshake =====
+inline void sha1(const uint8_t* data, size_t length, uint8_t digest[20]) {
+  uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+  auto rol = [](uint32_t x, int n) { return (x << n) | (x >> (32 - n)); };
+
+  uint64_t bits = (uint64_t)length * 8;
+  size_t total = ((length + 8) / 64 + 1) * 64;
+
+  for (size_t block = 0; block < total; block += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+      uint32_t word = 0;
+      for (int b = 0; b < 4; b++) {
+        size_t pos = block + i * 4 + b;
+        uint8_t byte;
+        if (pos < length) byte = data[pos];
+        else if (pos == length) byte = 0x80;
+        else if (pos >= total - 8) byte = (uint8_t)(bits >> ((total - 1 - pos) * 8));
+        else byte = 0;
+        word = (word << 8) | byte;
+      }
+      w[i] = word;
+    }
+    for (int i = 16; i < 80; i++) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+      uint32_t f, k;
+      if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+      else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+      else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+      else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+      uint32_t t = rol(a, 5) + f + e + k + w[i];
+      e = d; d = c; c = rol(b, 30); b = a; a = t;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+  }
+
+  for (int i = 0; i < 20; i++) digest[i] = (uint8_t)(h[i / 4] >> (24 - (i % 4) * 8));
+}
+
+inline std::string base64(const uint8_t* data, size_t length) {
+  static const char ALPHABET[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t n = data[i] << 16;
+    if (i + 1 < length) n |= data[i + 1] << 8;
+    if (i + 2 < length) n |= data[i + 2];
+    out += ALPHABET[(n >> 18) & 63];
+    out += ALPHABET[(n >> 12) & 63];
+    out += i + 1 < length ? ALPHABET[(n >> 6) & 63] : '=';
+    out += i + 2 < length ? ALPHABET[n & 63] : '=';
+  }
+  return out;
+}
+
+// Sec-WebSocket-Accept for a client's Sec-WebSocket-Key
+inline std::string wsAcceptKey(const std::string& key) {
+  std::string text = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+  uint8_t digest[20];
+  sha1((const uint8_t*)text.data(), text.size(), digest);
+  return base64(digest, sizeof(digest));
+}
+
+// Value of `name` in an HTTP header block, or "" when absent
+inline std::string httpHeader(const std::string& request, const char* name) {
+  std::string needle = std::string("\r\n") + name + ":";
+  size_t pos = request.find(needle);
+  if (pos == std::string::npos) return "";
+  pos += needle.size();
+  while (pos < request.size() && request[pos] == ' ') pos++;
+  size_t end = request.find("\r\n", pos);
+  return request.substr(pos, end - pos);
+}
+
+// ===== Frames =====
+// Writes one frame into `out` (at least WS_MAX_HEADER + length bytes) and
+// returns its size. Clients must mask, servers must not.
+inline size_t wsEncodeFrame(uint8_t opcode, const void* payload, size_t length,
+                            uint32_t maskKey, bool masked, uint8_t* out) {
+  size_t n = 0;
+  out[n++] = 0x80 | opcode;
+
+  uint8_t maskBit = masked ? 0x80 : 0;
+  if (length < 126) {
+    out[n++] = maskBit | (uint8_t)length;
+  } else {
+    out[n++] = maskBit | 126;
+    out[n++] = (uint8_t)(length >> 8);
+    out[n++] = (uint8_t)length;
+  }
+
+  const uint8_t* bytes = (const uint8_t*)payload;
+  if (masked) {
+    uint8_t mask[4] = {
+      (uint8_t)(maskKey >> 24), (uint8_t)(maskKey >> 16), (uint8_t)(maskKey >> 8), (uint8_t)maskKey
+    };
+    memcpy(out + n, mask, 4);
+    n += 4;
+    for (size_t i = 0; i < length; i++) out[n + i] = bytes[i] ^ mask[i & 3];
+  } else {
+    memcpy(out + n, bytes, length);
+  }
+  return n + length;
+}
+
+struct WsFrame {
+  uint8_t opcode;
+  uint8_t* payload;
+  size_t length;
+};
+
+// Parses the frame at the start of `data`, unmasking its payload in place.
+// Returns the frame's total size, 0 if more bytes are needed, or -1 for a
+// frame this implementation does not accept.
+inline long wsDecodeFrame(uint8_t* data, size_t available, WsFrame& frame) {
+  if (available < 2) return 0;
+  if (!(data[0] & 0x80)) return -1;  // fragmented
+
+  frame.opcode = data[0] & 0x0F;
+  bool masked = data[1] & 0x80;
+  size_t length = data[1] & 0x7F;
+  size_t n = 2;
+
+  if (length == 126) {
+    if (available < 4) return 0;
+    length = (data[2] << 8) | data[3];
+    n = 4;
+  } else if (length == 127) {
+    return -1;
+  }
+  if (length > WS_MAX_PAYLOAD) return -1;
+
+  size_t maskAt = n;
+  if (masked) n += 4;
+  if (available < n + length) return 0;
+
+  frame.payload = data + n;
+  frame.length = length;
+  if (masked) {
+    for (size_t i = 0; i < length; i++) frame.payload[i] ^= data[maskAt + (i & 3)];
+  }
+  return (long)(n + length);
+}
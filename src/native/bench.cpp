@@ -0,0 +1,296 @@
+// Microbenchmarks for the control hot paths.
+//
+//   bench [-o results.csv] [-b baseline.csv] [-t tolerance] [-f filter]
+//
+// Prints ns/op and heap allocations/op for every benchmark and writes them
+// as CSV (name,ns_per_op,allocs_per_op). With -b, a benchmark fails when it
+// is more than `tolerance` (default 0.30 = 30 %, and at least 5 ns) slower
+// than its baseline or allocates more, and the exit code is 1. Regenerate
+// the baseline by writing the results over it: bench -o bench/baseline.csv
+
+#include <CarCore.h>
+
+#include "HostBindings.h"
+#include "HostWebSocket.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// ===== Allocation Counting =====
+// Interposes the C allocator, which operator new also ends up in.
+namespace {
+size_t allocations = 0;
+}
+
+#ifdef __GLIBC__
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) { allocations++; return __libc_malloc(size); }
+void* calloc(size_t count, size_t size) { allocations++; return __libc_calloc(count, size); }
+void* realloc(void* ptr, size_t size) { allocations++; return __libc_realloc(ptr, size); }
+}
+#endif
+
+namespace {
+
+constexpr double MIN_BATCH_MS = 10;
+constexpr int SAMPLES = 7;
+// A benchmark that looks slower is measured again before it counts as a
+// regression, so one noisy sample cannot fail the run
+constexpr int CONFIRM_RUNS = 3;
+// The allowed slowdown is `tolerance` of the baseline but at least this
+// much, so a few ns of timer jitter on the cheapest paths do not count
+constexpr double MIN_SLACK_NS = 5;
+
+struct Benchmark {
+  std::string name;
+  std::function<void()> setup;
+  std::function<void()> op;
+};
+
+struct Result {
+  std::string name;
+  double nsPerOp;
+  double allocsPerOp;
+};
+
+// Does what WebSocketsServer does per message: broadcastTXT() walks every
+// slot and frames the text for each connected client, so a broadcast costs
+// more with every client. Clients sit on every other slot, leaving gaps
+// for the walk to skip, as disconnects do on the car.
+class FanOutLink : public CarLink {
+ public:
+  static constexpr uint8_t SLOTS = 16;
+
+  void send(uint8_t client, const char* text, size_t length) override {
+    if (client < SLOTS && connected[client]) frame(client, text, length);
+  }
+
+  void broadcast(const char* text, size_t length) override {
+    for (uint8_t i = 0; i < SLOTS; i++) {
+      if (connected[i]) frame(i, text, length);
+    }
+  }
+
+  uint8_t clientCount() override { return clients; }
+
+  void connect(uint8_t count) {
+    clients = count;
+    for (uint8_t i = 0; i < SLOTS; i++) connected[i] = i % 2 == 0 && i / 2 < count;
+  }
+
+  uint64_t bytes = 0;
+
+ private:
+  void frame(uint8_t client, const char* text, size_t length) {
+    if (length > PAYLOAD_MAX) length = PAYLOAD_MAX;
+    bytes += wsEncodeFrame(WS_OP_TEXT, text, length, 0, false, out[client]);
+  }
+
+  static constexpr size_t PAYLOAD_MAX = 256;
+
+  bool connected[SLOTS] = {};
+  uint8_t clients = 0;
+  uint8_t out[SLOTS][WS_MAX_HEADER + PAYLOAD_MAX];
+};
+
+HostHal hal;
+FanOutLink fanOutLink;
+Car car(hal, fanOutLink);
+
+void freshCar(uint8_t clients) {
+  hal.now = 0;
+  fanOutLink.connect(clients);
+  car.begin();
+}
+
+void command(const char* text) {
+  car.dispatchText(0, text, strlen(text));
+}
+
+std::vector<Benchmark> benchmarks() {
+  std::vector<Benchmark> list;
+
+  // One benchmark per command type, each with one client connected
+  static const char* const COMMANDS[] = {
+    "forward", "backward", "left", "right", "stop", "speed:50",
+    "headlight:on", "indicator-left:on", "hazard:on", "horn", "garage",
+    "fx:headlight:breathe", "getState", "ping", "config:get", "config:set:hornMs=300",
+    "unknown"
+  };
+  for (const char* cmd : COMMANDS) {
+    list.push_back({ std::string("handleWebSocketCommand/") + cmd,
+                     [] { freshCar(1); },
+                     [cmd] { car.handleWebSocketCommand(0, cmd, strlen(cmd)); } });
+  }
+
+  list.push_back({ "updateClientState", [] { freshCar(1); }, [] { car.updateClientState(0); } });
+  for (uint8_t clients : { 1, 2, 4, 8 }) {
+    list.push_back({ "broadcastState/" + std::to_string(clients),
+                     [clients] { freshCar(clients); },
+                     [] { car.broadcastState(); } });
+  }
+
+  list.push_back({ "setSpeed", [] { freshCar(1); command("forward"); },
+                   [] { car.setSpeed(50); } });
+
+  // Step the clock past the debounce window so every call is handled
+  list.push_back({ "handleIRCommand/forward", [] { freshCar(1); },
+                   [] { hal.now += DEBOUNCE_DELAY; car.handleIRCommand(0xFF629D); } });
+  list.push_back({ "handleIRCommand/unknown", [] { freshCar(1); },
+                   [] { hal.now += DEBOUNCE_DELAY; car.handleIRCommand(0x123456); } });
+  list.push_back({ "handleIRCommand/debounced", [] { freshCar(1); },
+                   [] { car.handleIRCommand(0xFF629D); } });
+
+  // The light sequencer replaced handleIndicators(); one control tick per op
+  list.push_back({ "handleControlTick/hazard", [] { freshCar(1); command("hazard:on"); },
+                   [] { hal.now += CONTROL_TICK_MS; car.handleControlTick(); } });
+  list.push_back({ "handleControlTick/idle", [] { freshCar(1); },
+                   [] { hal.now += CONTROL_TICK_MS; car.handleControlTick(); } });
+
+  return list;
+}
+
+Result run(const Benchmark& bench) {
+  using Clock = std::chrono::steady_clock;
+
+  bench.setup();
+
+  // Grow the batch until it takes long enough to time reliably
+  uint64_t iterations = 1;
+  for (;;) {
+    auto start = Clock::now();
+    for (uint64_t i = 0; i < iterations; i++) bench.op();
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    if (ms >= MIN_BATCH_MS || iterations >= (1ULL << 30)) break;
+    iterations *= 2;
+  }
+
+  double best = 1e300;
+  size_t allocs = 0;
+  for (int s = 0; s < SAMPLES; s++) {
+    bench.setup();
+    size_t before = allocations;
+    auto start = Clock::now();
+    for (uint64_t i = 0; i < iterations; i++) bench.op();
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    allocs = allocations - before;
+    best = std::min(best, ns / iterations);
+  }
+
+  return { bench.name, best, (double)allocs / iterations };
+}
+
+std::map<std::string, Result> readBaseline(const char* path) {
+  std::map<std::string, Result> baseline;
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    std::stringstream fields(line);
+    Result r;
+    std::string ns, allocs;
+    if (!std::getline(fields, r.name, ',') || !std::getline(fields, ns, ',') ||
+        !std::getline(fields, allocs)) continue;
+    if (r.name == "name") continue;
+    r.nsPerOp = atof(ns.c_str());
+    r.allocsPerOp = atof(allocs.c_str());
+    baseline[r.name] = r;
+  }
+  return baseline;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* output = nullptr;
+  const char* baselinePath = nullptr;
+  const char* filter = nullptr;
+  double tolerance = 0.30;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-o") && i + 1 < argc) output = argv[++i];
+    else if (!strcmp(argv[i], "-b") && i + 1 < argc) baselinePath = argv[++i];
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc) tolerance = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-f") && i + 1 < argc) filter = argv[++i];
+    else {
+      fprintf(stderr, "usage: %s [-o results.csv] [-b baseline.csv] [-t tolerance] [-f filter]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  std::map<std::string, Result> baseline;
+  if (baselinePath) {
+    baseline = readBaseline(baselinePath);
+    if (baseline.empty()) {
+      fprintf(stderr, "%s: no baseline entries\n", baselinePath);
+      return 2;
+    }
+  }
+
+  std::vector<Result> results;
+  int regressions = 0;
+
+  printf("%-44s %12s %12s %s\n", "benchmark", "ns/op", "allocs/op", baselinePath ? "vs baseline" : "");
+  for (const Benchmark& bench : benchmarks()) {
+    if (filter && bench.name.find(filter) == std::string::npos) continue;
+
+    Result r = run(bench);
+    results.push_back(r);
+
+    auto base = baseline.find(r.name);
+    bool slower = false, allocates = false;
+    if (base != baseline.end()) {
+      auto isSlower = [&] {
+        double slack = std::max(base->second.nsPerOp * tolerance, MIN_SLACK_NS);
+        return r.nsPerOp - base->second.nsPerOp > slack;
+      };
+      for (int i = 0; i < CONFIRM_RUNS && isSlower(); i++) {
+        r.nsPerOp = std::min(r.nsPerOp, run(bench).nsPerOp);
+      }
+      results.back() = r;
+      slower = isSlower();
+      allocates = r.allocsPerOp > base->second.allocsPerOp + 0.01;
+      if (slower || allocates) regressions++;
+    }
+
+    printf("%-44s %12.1f %12.2f", r.name.c_str(), r.nsPerOp, r.allocsPerOp);
+    if (base != baseline.end()) {
+      printf("   %+6.1f %%%s%s", (r.nsPerOp / base->second.nsPerOp - 1) * 100,
+             slower ? "  SLOWER" : "", allocates ? "  ALLOCATES" : "");
+    } else if (baselinePath) {
+      printf("   (new)");
+    }
+    printf("\n");
+  }
+
+  if (output) {
+    FILE* file = fopen(output, "w");
+    if (!file) {
+      fprintf(stderr, "cannot write %s\n", output);
+      return 2;
+    }
+    fprintf(file, "name,ns_per_op,allocs_per_op\n");
+    for (const Result& r : results) {
+      fprintf(file, "%s,%.1f,%.2f\n", r.name.c_str(), r.nsPerOp, r.allocsPerOp);
+    }
+    fclose(file);
+  }
+
+  if (regressions) {
+    printf("%d regression(s) against %s\n", regressions, baselinePath);
+    return 1;
+  }
+  return 0;
+}
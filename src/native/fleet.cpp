@@ -0,0 +1,288 @@
+// Steps a fleet of independent cars, each with its own plant and link,
+// across worker threads.
+//
+//   fleet [-n cars] [-j threads] [-t seconds] [-e] [-p] [-s seed]
+//
+// Every car has a seeded driver that holds directions with the page's
+// 100 ms repeat, changes speed, toggles lights, presses IR buttons, asks
+// for the state and uploads and runs a motion script. Time advances in
+// epochs of EPOCH_MS that all cars finish before any starts the next, which
+// is where cars could later see each other. Within an epoch workers claim
+// cars in small batches from a shared counter, so cars that cost more
+// (scripts, closed-loop control with -e) do not leave other workers idle;
+// -p gives each worker a fixed slice instead, for comparison.
+//
+// Cars depend only on their own seed, so the printed checksum is the same
+// for any thread count.
+
+#include <CarCore.h>
+#include <CarSim.h>
+
+#include "HostBindings.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t LOOP_PERIOD_MS = 10;
+constexpr uint32_t EPOCH_MS = 100;
+constexpr size_t CLAIM_BATCH = 4;
+constexpr uint32_t HOLD_REPEAT_MS = 100;
+
+const char* const DIRECTIONS[] = { "forward", "backward", "left", "right" };
+
+const char* const TOGGLES[] = {
+  "headlight:on", "headlight:off", "hazard:on", "hazard:off",
+  "indicator-left:on", "indicator-right:on", "horn", "garage", "fx:headlight:breathe"
+};
+
+const uint32_t IR_CODES[] = {
+  0xFFA25D, 0xFF629D, 0xFFA857, 0xFF22DD, 0xFFC23D, 0xFF02FD, 0xFF9867, 0xFFB04F
+};
+
+// Two laps of a square with lights, then a chirp
+const uint8_t SQUARE_SCRIPT[] = {
+  SCRIPT_MAGIC0, SCRIPT_MAGIC1, SCRIPT_VERSION,
+  OP_LIGHTS, SCRIPT_LIGHT_HEADLIGHT,
+  OP_LOOP, 8,
+    OP_DRIVE, 70, 70, 0xE8, 0x03,      // 1000 ms
+    OP_DRIVE, 60, (uint8_t)-60, 0x5E, 0x01,  // 350 ms
+  OP_NEXT,
+  OP_HORN, SCRIPT_HORN_CHIRP,
+  OP_END
+};
+
+class FleetCar {
+ public:
+  FleetCar(const PlantParams& params, uint32_t seed) : sim(params), rng(seed) {
+    link.clients = 1;
+    car.begin();
+  }
+
+  // One epoch of driving, in firmware loop() steps
+  void step(uint32_t ms) {
+    for (uint32_t t = 0; t < ms; t += LOOP_PERIOD_MS) {
+      sim.advance(LOOP_PERIOD_MS);
+      drive(sim.millis());
+      car.handleControlTick();
+      car.sendHeartbeat();
+    }
+  }
+
+  uint64_t checksum() const {
+    // FNV-1a over what the run leaves behind
+    uint64_t hash = 1469598103934665603ULL;
+    auto mix = [&](uint64_t value) {
+      for (int i = 0; i < 8; i++, value >>= 8) hash = (hash ^ (value & 0xFF)) * 1099511628211ULL;
+    };
+    RecordedState s = car.recordedState();
+    mix(s.direction);
+    mix(s.pwmSpeed);
+    mix(s.flags);
+    mix(link.messages);
+    mix((uint64_t)(int64_t)(sim.distance * 1000));
+    return hash;
+  }
+
+  CarSim sim;
+  HostLink link;
+  Car car{sim, link};
+
+  uint32_t commands = 0;
+  uint32_t scripts = 0;
+
+ private:
+  void command(const char* text) {
+    car.dispatchText(0, text, strlen(text));
+    commands++;
+  }
+
+  void drive(uint32_t now) {
+    if (now < nextCommand) return;
+
+    if (holdRemaining > 0) {
+      command(--holdRemaining > 0 ? holdCommand : "stop");
+      nextCommand = now + (holdRemaining > 0 ? HOLD_REPEAT_MS : between(200, 1500));
+      return;
+    }
+
+    int roll = between(0, 99);
+    if (roll < 40) {
+      holdCommand = DIRECTIONS[between(0, 3)];
+      holdRemaining = between(5, 30);
+      command(holdCommand);
+      nextCommand = now + HOLD_REPEAT_MS;
+      return;
+    }
+
+    if (roll < 55) {
+      char text[16];
+      snprintf(text, sizeof(text), "speed:%d", between(20, 100));
+      command(text);
+    } else if (roll < 70) {
+      command(TOGGLES[between(0, sizeof(TOGGLES) / sizeof(TOGGLES[0]) - 1)]);
+    } else if (roll < 80) {
+      car.dispatchIR(IR_CODES[between(0, sizeof(IR_CODES) / sizeof(IR_CODES[0]) - 1)]);
+      commands++;
+    } else if (roll < 84) {
+      car.dispatchBinary(0, SQUARE_SCRIPT, sizeof(SQUARE_SCRIPT));
+      command("script:run");
+      scripts++;
+      nextCommand = now + between(5000, 15000);  // let it drive for a while
+      return;
+    } else {
+      command("getState");
+    }
+    nextCommand = now + between(100, 1500);
+  }
+
+  int between(int lo, int hi) {
+    return std::uniform_int_distribution<int>(lo, hi)(rng);
+  }
+
+  std::mt19937 rng;
+  uint32_t nextCommand = 0;
+  const char* holdCommand = nullptr;
+  int holdRemaining = 0;
+};
+
+// All workers meet here at the end of every epoch
+class Barrier {
+ public:
+  explicit Barrier(size_t count) : count(count) {}
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t arrived = generation;
+    if (++waiting == count) {
+      waiting = 0;
+      generation++;
+      released.notify_all();
+    } else {
+      released.wait(lock, [&] { return generation != arrived; });
+    }
+  }
+
+ private:
+  std::mutex mutex;
+  std::condition_variable released;
+  size_t count;
+  size_t waiting = 0;
+  size_t generation = 0;
+};
+
+PlantParams randomPlant(std::mt19937& rng, bool encoders) {
+  auto uniform = [&](double lo, double hi) {
+    return std::uniform_real_distribution<double>(lo, hi)(rng);
+  };
+  PlantParams p;
+  p.batteryVoltage = uniform(6.8, 8.4);
+  p.sideMismatch = uniform(-0.05, 0.05);
+  p.motorTau = uniform(0.08, 0.16);
+  p.encoderCpr = encoders ? ENCODER_CPR : 0;
+  return p;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t count = 300;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  double seconds = 10;
+  bool encoders = false;
+  bool partitioned = false;
+  unsigned seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) count = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-j") && i + 1 < argc) threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc) seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-e")) encoders = true;
+    else if (!strcmp(argv[i], "-p")) partitioned = true;
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) seed = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [-n cars] [-j threads] [-t seconds] [-e] [-p] [-s seed]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (count < 1 || threads < 1 || seconds <= 0) {
+    fprintf(stderr, "need at least one car, one thread and a positive duration\n");
+    return 2;
+  }
+  threads = std::min(threads, count);
+
+  std::vector<std::unique_ptr<FleetCar>> cars;
+  for (size_t i = 0; i < count; i++) {
+    std::mt19937 rng(seed * 7919 + i);
+    cars.push_back(std::make_unique<FleetCar>(randomPlant(rng, encoders), rng()));
+  }
+
+  const size_t epochs = (size_t)(seconds * 1000 / EPOCH_MS);
+  std::vector<std::atomic<size_t>> nextCar(epochs);
+  for (auto& next : nextCar) next = 0;
+  std::vector<double> busyMs(threads);
+  Barrier barrier(threads);
+
+  auto worker = [&](size_t id) {
+    using Clock = std::chrono::steady_clock;
+    for (size_t epoch = 0; epoch < epochs; epoch++) {
+      auto start = Clock::now();
+      if (partitioned) {
+        size_t end = (id + 1) * count / threads;
+        for (size_t i = id * count / threads; i < end; i++) cars[i]->step(EPOCH_MS);
+      } else {
+        for (;;) {
+          size_t first = nextCar[epoch].fetch_add(CLAIM_BATCH);
+          if (first >= count) break;
+          size_t end = std::min(first + CLAIM_BATCH, count);
+          for (size_t i = first; i < end; i++) cars[i]->step(EPOCH_MS);
+        }
+      }
+      busyMs[id] += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+      barrier.wait();
+    }
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> pool;
+  for (size_t id = 1; id < threads; id++) pool.emplace_back(worker, id);
+  worker(0);
+  for (std::thread& t : pool) t.join();
+  double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  uint64_t commands = 0, messages = 0, scripts = 0, checksum = 0;
+  double distance = 0, minDistance = 1e9, maxDistance = 0;
+  for (const auto& c : cars) {
+    commands += c->commands;
+    messages += c->link.messages;
+    scripts += c->scripts;
+    distance += c->sim.distance;
+    minDistance = std::min(minDistance, c->sim.distance);
+    maxDistance = std::max(maxDistance, c->sim.distance);
+    checksum = checksum * 31 + c->checksum();
+  }
+  auto busy = std::minmax_element(busyMs.begin(), busyMs.end());
+
+  double simulatedS = epochs * EPOCH_MS / 1000.0;
+  printf("cars=%zu threads=%zu mode=%s simulated_s=%.1f encoders=%s\n",
+         count, threads, partitioned ? "partitioned" : "shared", simulatedS, encoders ? "on" : "off");
+  printf("commands=%llu messages=%llu scripts=%llu distance_m=%.1f/%.1f/%.1f (min/mean/max)\n",
+         (unsigned long long)commands, (unsigned long long)messages, (unsigned long long)scripts,
+         minDistance, distance / count, maxDistance);
+  printf("wall_ms=%.1f car_seconds_per_s=%.0f worker_busy=%.0f..%.0f%% checksum=%016llx\n",
+         wallMs, count * simulatedS / (wallMs / 1000),
+         *busy.first / wallMs * 100, *busy.second / wallMs * 100,
+         (unsigned long long)checksum);
+  return 0;
+}
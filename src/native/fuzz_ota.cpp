@@ -0,0 +1,70 @@
+// Fuzz target for the firmware update path.
+//
+// An input is an update package as POST /update receives it. It is fed to
+// OtaReceiver in pieces of varying size, against a fixed 4 KB running image
+// for deltas. After every piece the target must hold exactly the chunks
+// written so far, never more than the header's image size, and a receiver
+// that has failed must have closed the target again. A package that is
+// accepted must have installed exactly the image its hash describes.
+
+#include "FuzzHarness.h"
+
+#include <OtaUpdate.h>
+
+#include <algorithm>
+
+namespace {
+
+constexpr size_t RUNNING_SIZE = 4096;
+constexpr size_t MAX_PIECE = 1460;
+
+HostOtaTarget target;
+OtaReceiver receiver(target);
+
+void checkTarget() {
+  fuzzCheck(receiver.written() <= receiver.imageSize() || !receiver.active(), "written <= imageSize");
+  fuzzCheck(!target.open || target.image.size() == receiver.written(), "target holds the written chunks");
+  fuzzCheck(receiver.active() || !target.open, "failed receiver closed the target");
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  if (target.current.empty()) {
+    for (size_t i = 0; i < RUNNING_SIZE; i++) target.current.push_back((uint8_t)(i * 31 + 7));
+  }
+  target.committed = false;
+  receiver.begin();
+
+  uint32_t rng = 2463534242u ^ (uint32_t)size;
+  size_t offset = 0;
+  while (offset < size && receiver.active()) {
+    rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+    size_t n = std::min((size_t)(1 + rng % MAX_PIECE), size - offset);
+    while (n > 0 && receiver.active()) {
+      uint32_t written = receiver.written();
+      size_t used = receiver.write(data + offset, n);
+      fuzzCheck(used <= n, "write uses at most what it is given");
+      fuzzCheck(used > 0 || receiver.written() > written || !receiver.active(), "write makes progress");
+      offset += used;
+      n -= used;
+      checkTarget();
+    }
+  }
+  while (receiver.busy()) {
+    receiver.write(nullptr, 0);
+    checkTarget();
+  }
+
+  if (receiver.finish() == OTA_OK) {
+    fuzzCheck(target.committed && target.image.size() == receiver.imageSize(), "installed the whole image");
+    Sha256 hash;
+    uint8_t digest[OTA_HASH_SIZE];
+    hash.update(target.image.data(), target.image.size());
+    hash.finish(digest);
+    fuzzCheck(size >= OTA_HEADER_SIZE && memcmp(digest, data + 16, OTA_HASH_SIZE) == 0,
+              "installed image matches the hash");
+  }
+  checkTarget();
+  return 0;
+}
@@ -0,0 +1,54 @@
+// Fuzz target for the WebSocket payload path: text commands, binary script
+// uploads and the control ticks in between, as the firmware sees them.
+//
+// An input is a sequence of events, each [kind][length lo][length hi]
+// followed by the payload:
+//   kind % 3 == 0  text frame of `length` bytes
+//   kind % 3 == 1  binary frame of `length` bytes
+//   kind % 3 == 2  `length` control ticks (no payload, at most 255)
+// Ticks are capped per input so that long inputs stay cheap to run. After
+// every event the PWM invariants are checked; see FuzzHarness.h.
+
+#include "FuzzHarness.h"
+
+namespace {
+
+constexpr uint32_t MAX_TICKS = 1000;  // 20 s of driving
+
+FuzzHal hal;
+HostLink hostLink;
+Car car(hal, hostLink);
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  hostLink.clients = 1;
+  hal.now = 0;
+  car.begin();
+
+  uint32_t ticks = 0;
+  size_t i = 0;
+  while (i + 3 <= size) {
+    uint8_t kind = data[i] % 3;
+    size_t length = data[i + 1] | (data[i + 2] << 8);
+    i += 3;
+
+    if (kind == 2) {
+      for (size_t t = 0; t < (length & 0xFF) && ticks < MAX_TICKS; t++, ticks++) {
+        hal.now += CONTROL_TICK_MS;
+        car.handleControlTick();
+        car.sendHeartbeat();
+      }
+    } else {
+      if (length > size - i) length = size - i;
+      std::vector<uint8_t> frame = exactCopy(data + i, length);
+      i += length;
+
+      hal.now += 1;
+      car.onClientEvent(0, kind == 0 ? CLIENT_TEXT : CLIENT_BINARY, frame.data(), frame.size());
+    }
+
+    checkInvariants(car, hal);
+  }
+  return 0;
+}
@@ -0,0 +1,432 @@
+// WebSocket load generator for the loopback server (or a car on the LAN).
+//
+//   loadgen [-h host] [-p port] [-c clients] [-d seconds] [-m mix] [-s seed]
+//
+// Each client plays one profile from `mix`, assigned round-robin (default
+// "hsgd"):
+//   h  hold: presses a direction for 0.5-3 s, repeating it every 100 ms as
+//      the page does, then sends "stop"
+//   s  slider: drags the speed slider, 15-30 "speed:N" at touch-move rate
+//   g  getState storm: 20-50 back-to-back "getState" every second
+//   d  disconnect: holds like h, then drops the connection without a close
+//      frame and reconnects 100-500 ms later
+// Every client also sends a "ping" probe every 200 ms. The server answers
+// frames of one connection in order, so probe-to-"pong" time includes the
+// wait behind that client's own queued commands; that is the latency
+// reported. Probes that are never answered count as dropped frames.
+
+#include "HostWebSocket.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr double HOLD_REPEAT_MS = 100;
+constexpr double SLIDER_STEP_MS = 16;
+constexpr double PROBE_INTERVAL_MS = 200;
+constexpr double RETRY_MS = 1000;
+constexpr double GRACE_MS = 1000;
+
+enum Profile : char { HOLD = 'h', SLIDER = 's', STORM = 'g', DISCONNECT = 'd' };
+
+enum ConnState { CLOSED, HANDSHAKE, OPEN };
+
+const char* const DIRECTIONS[] = { "forward", "backward", "left", "right" };
+
+struct Client {
+  int id;
+  Profile profile;
+  std::mt19937 rng;
+
+  int fd = -1;
+  ConnState state = CLOSED;
+  std::string key;
+  std::string in;
+
+  // Profile state machine
+  double nextAction = 0;
+  double nextProbe = 0;
+  double connectAt = 0;
+  bool askState = false;
+  int remaining = 0;        // commands left in the current hold or burst
+  const char* command = nullptr;
+  int sliderValue = 50;
+
+  std::deque<double> probes;
+  std::vector<double> latencies;
+
+  uint64_t sent = 0;
+  uint64_t received = 0;
+  uint64_t states = 0;
+  uint64_t unsent = 0;
+  uint64_t lost = 0;
+  uint32_t reconnects = 0;
+  uint32_t refused = 0;
+
+  double uniform(double lo, double hi) {
+    return std::uniform_real_distribution<double>(lo, hi)(rng);
+  }
+  int between(int lo, int hi) {
+    return std::uniform_int_distribution<int>(lo, hi)(rng);
+  }
+};
+
+std::string host = "127.0.0.1";
+uint16_t port = 8081;
+double duration = 10;
+double deadline = 0;
+
+double nowMs() {
+  static const auto start = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ===== Connection =====
+void closeClient(Client& c, bool abrupt) {
+  if (c.fd < 0) return;
+  if (abrupt) {
+    linger reset = { 1, 0 };  // RST instead of FIN, like a phone losing Wi-Fi
+    setsockopt(c.fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+  }
+  close(c.fd);
+  c.fd = -1;
+  c.state = CLOSED;
+  c.in.clear();
+}
+
+void startConnect(Client& c) {
+  addrinfo hints = {}, *addr = nullptr;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addr) != 0) {
+    c.refused++;
+    c.connectAt = nowMs() + RETRY_MS;
+    return;
+  }
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  bool ok = connect(fd, addr->ai_addr, addr->ai_addrlen) == 0;
+  freeaddrinfo(addr);
+  if (!ok) {
+    close(fd);
+    c.refused++;
+    c.connectAt = nowMs() + RETRY_MS;
+    return;
+  }
+
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+
+  uint8_t nonce[16];
+  for (uint8_t& b : nonce) b = (uint8_t)c.between(0, 255);
+  c.key = base64(nonce, sizeof(nonce));
+
+  std::string request =
+    "GET / HTTP/1.1\r\n"
+    "Host: " + host + ":" + std::to_string(port) + "\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Key: " + c.key + "\r\n"
+    "Sec-WebSocket-Version: 13\r\n\r\n";
+  send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+
+  c.fd = fd;
+  c.state = HANDSHAKE;
+}
+
+void sendText(Client& c, const char* text) {
+  if (c.state != OPEN) return;
+
+  uint8_t frame[WS_MAX_HEADER + WS_MAX_PAYLOAD];
+  size_t size = wsEncodeFrame(WS_OP_TEXT, text, strlen(text), c.rng(), true, frame);
+  ssize_t n = send(c.fd, frame, size, MSG_NOSIGNAL);
+  if (n == (ssize_t)size) {
+    c.sent++;
+  } else {
+    // A partial frame would corrupt the stream, so give up on the connection
+    c.unsent++;
+    if (n > 0) closeClient(c, true);
+  }
+}
+
+// ===== Profiles =====
+void onOpen(Client& c, double now) {
+  c.state = OPEN;
+  c.probes.clear();
+  c.nextProbe = now + PROBE_INTERVAL_MS;
+  c.remaining = 0;
+  c.askState = true;
+  c.nextAction = now + 100;  // the page asks for the state 100 ms after connecting
+}
+
+void runAction(Client& c, double now) {
+  if (c.askState) {
+    sendText(c, "getState");
+    c.askState = false;
+    c.nextAction = now + c.uniform(0, 500);
+    return;
+  }
+
+  switch (c.profile) {
+    case HOLD:
+    case DISCONNECT:
+      if (c.remaining == 0) {
+        c.command = DIRECTIONS[c.between(0, 3)];
+        c.remaining = (int)(c.uniform(c.profile == HOLD ? 500 : 300, c.profile == HOLD ? 3000 : 2000) / HOLD_REPEAT_MS);
+      }
+      if (--c.remaining > 0) {
+        sendText(c, c.command);
+        c.nextAction = now + HOLD_REPEAT_MS;
+      } else if (c.profile == DISCONNECT) {
+        closeClient(c, true);
+        c.reconnects++;
+        c.connectAt = now + c.uniform(100, 500);
+      } else {
+        sendText(c, "stop");
+        c.nextAction = now + c.uniform(200, 1000);
+      }
+      break;
+
+    case SLIDER: {
+      if (c.remaining == 0) c.remaining = c.between(15, 30);
+      c.sliderValue = std::max(0, std::min(100, c.sliderValue + c.between(-5, 5)));
+      char text[16];
+      snprintf(text, sizeof(text), "speed:%d", c.sliderValue);
+      sendText(c, text);
+      c.nextAction = now + (--c.remaining > 0 ? SLIDER_STEP_MS : c.uniform(500, 1500));
+      break;
+    }
+
+    case STORM:
+      for (int i = c.between(20, 50); i > 0; i--) sendText(c, "getState");
+      c.nextAction = now + 1000;
+      break;
+  }
+}
+
+// ===== Receiving =====
+void onFrame(Client& c, const WsFrame& frame, double now) {
+  c.received++;
+  if (frame.opcode == WS_OP_CLOSE) {
+    c.lost += c.probes.size();
+    closeClient(c, false);
+    c.connectAt = now + RETRY_MS;
+    return;
+  }
+  if (frame.opcode != WS_OP_TEXT) return;
+
+  std::string text((const char*)frame.payload, frame.length);
+  if (text == "pong" && !c.probes.empty()) {
+    c.latencies.push_back(now - c.probes.front());
+    c.probes.pop_front();
+  } else if (text.compare(0, 6, "state:") == 0) {
+    c.states++;
+  }
+}
+
+void receive(Client& c, double now) {
+  char buffer[4096];
+  for (;;) {
+    ssize_t n = recv(c.fd, buffer, sizeof(buffer), 0);
+    if (n > 0) {
+      c.in.append(buffer, n);
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+    // Closed by the server: a full server drops the socket before the upgrade
+    if (c.state == HANDSHAKE) c.refused++;
+    c.lost += c.probes.size();
+    closeClient(c, false);
+    c.connectAt = now + RETRY_MS;
+    return;
+  }
+
+  if (c.state == HANDSHAKE) {
+    size_t end = c.in.find("\r\n\r\n");
+    if (end == std::string::npos) return;
+    bool accepted = c.in.compare(0, 12, "HTTP/1.1 101") == 0 &&
+                    httpHeader(c.in, "Sec-WebSocket-Accept") == wsAcceptKey(c.key);
+    c.in.erase(0, end + 4);
+    if (!accepted) {
+      c.refused++;
+      closeClient(c, false);
+      c.connectAt = now + RETRY_MS;
+      return;
+    }
+    onOpen(c, now);
+  }
+
+  while (c.state == OPEN) {
+    WsFrame frame;
+    long size = wsDecodeFrame((uint8_t*)&c.in[0], c.in.size(), frame);
+    if (size == 0) break;
+    if (size < 0) {
+      c.lost += c.probes.size();
+      closeClient(c, false);
+      c.connectAt = now + RETRY_MS;
+      return;
+    }
+    onFrame(c, frame, now);
+    if (c.fd >= 0) c.in.erase(0, size);
+  }
+}
+
+// ===== Report =====
+double percentile(std::vector<double> values, double p) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  size_t rank = (size_t)(p / 100 * (values.size() - 1) + 0.5);
+  return values[rank];
+}
+
+const char* profileName(Profile p) {
+  switch (p) {
+    case HOLD: return "hold";
+    case SLIDER: return "slider";
+    case STORM: return "storm";
+    case DISCONNECT: return "disconnect";
+  }
+  return "?";
+}
+
+void report(const std::vector<Client>& clients, double seconds) {
+  printf("%-6s %-10s %8s %8s %8s %7s %7s %7s %7s %5s %6s %5s %5s\n",
+         "client", "profile", "sent", "recv", "states", "p50_ms", "p95_ms", "p99_ms", "max_ms",
+         "lost", "unsent", "recon", "refus");
+
+  std::vector<double> all;
+  uint64_t sent = 0, received = 0, lost = 0, unsent = 0, probes = 0;
+  for (const Client& c : clients) {
+    printf("%-6d %-10s %8llu %8llu %8llu %7.1f %7.1f %7.1f %7.1f %5llu %6llu %5u %5u\n",
+           c.id, profileName(c.profile),
+           (unsigned long long)c.sent, (unsigned long long)c.received, (unsigned long long)c.states,
+           percentile(c.latencies, 50), percentile(c.latencies, 95), percentile(c.latencies, 99),
+           percentile(c.latencies, 100),
+           (unsigned long long)c.lost, (unsigned long long)c.unsent, c.reconnects, c.refused);
+    all.insert(all.end(), c.latencies.begin(), c.latencies.end());
+    sent += c.sent;
+    received += c.received;
+    lost += c.lost;
+    unsent += c.unsent;
+    probes += c.latencies.size() + c.lost;
+  }
+
+  printf("seconds=%.1f sent=%llu received=%llu sent_per_s=%.0f received_per_s=%.0f\n",
+         seconds, (unsigned long long)sent, (unsigned long long)received,
+         sent / seconds, received / seconds);
+  printf("probes=%llu dropped=%llu unsent=%llu p50_ms=%.1f p95_ms=%.1f p99_ms=%.1f max_ms=%.1f\n",
+         (unsigned long long)probes, (unsigned long long)lost, (unsigned long long)unsent,
+         percentile(all, 50), percentile(all, 95), percentile(all, 99), percentile(all, 100));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int count = 8;
+  std::string mix = "hsgd";
+  unsigned seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-h") && i + 1 < argc) host = argv[++i];
+    else if (!strcmp(argv[i], "-p") && i + 1 < argc) port = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-c") && i + 1 < argc) count = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-d") && i + 1 < argc) duration = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-m") && i + 1 < argc) mix = argv[++i];
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) seed = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [-h host] [-p port] [-c clients] [-d seconds] [-m mix] [-s seed]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (count < 1 || mix.empty() || mix.find_first_not_of("hsgd") != std::string::npos) {
+    fprintf(stderr, "need at least one client and a mix of h, s, g and d\n");
+    return 2;
+  }
+
+  std::vector<Client> clients;
+  for (int i = 0; i < count; i++) {
+    Client c;
+    c.id = i;
+    c.profile = (Profile)mix[i % mix.size()];
+    c.rng.seed(seed * 7919 + i);
+    c.connectAt = i * 20.0;  // phones do not all join in the same millisecond
+    clients.push_back(c);
+  }
+
+  deadline = duration * 1000;
+  double now = nowMs();
+
+  while (now < deadline + GRACE_MS) {
+    bool sending = now < deadline;
+    double wake = deadline + GRACE_MS;
+
+    for (Client& c : clients) {
+      if (c.state == CLOSED && sending && now >= c.connectAt) startConnect(c);
+      if (c.state == OPEN && sending) {
+        if (now >= c.nextProbe) {
+          sendText(c, "ping");
+          if (c.state == OPEN) c.probes.push_back(now);
+          c.nextProbe += PROBE_INTERVAL_MS;
+        }
+        if (now >= c.nextAction) runAction(c, now);
+      }
+
+      if (c.state == CLOSED) {
+        if (sending) wake = std::min(wake, c.connectAt);
+      } else if (c.state == OPEN && sending) {
+        wake = std::min(wake, std::min(c.nextProbe, c.nextAction));
+      }
+    }
+
+    std::vector<pollfd> fds;
+    std::vector<Client*> owners;
+    for (Client& c : clients) {
+      if (c.fd < 0) continue;
+      fds.push_back({ c.fd, POLLIN, 0 });
+      owners.push_back(&c);
+    }
+
+    int timeout = (int)std::max(0.0, std::min(wake - nowMs(), 100.0));
+    poll(fds.data(), fds.size(), timeout);
+
+    now = nowMs();
+    for (size_t i = 0; i < fds.size(); i++) {
+      if (fds[i].revents) receive(*owners[i], now);
+    }
+  }
+
+  bool connected = false;
+  for (Client& c : clients) {
+    c.lost += c.probes.size();
+    c.probes.clear();
+    connected |= c.received > 0;
+    closeClient(c, false);
+  }
+
+  report(clients, duration);
+  if (!connected) {
+    fprintf(stderr, "no client got through to %s:%u\n", host.c_str(), port);
+    return 1;
+  }
+  return 0;
+}
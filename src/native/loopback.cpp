@@ -0,0 +1,330 @@
+// Serves the car logic over a real WebSocket on 127.0.0.1 for the load
+// generator, with the firmware's event handler, client limit and loop
+// cadence.
+//
+//   loopback [-p port] [-m max_clients] [-t seconds] [-v]
+//
+// Like WebSocketsServer on the ESP8266, each loop() pass handles at most one
+// frame per client before the 10 ms delay, and a connection beyond the
+// client limit is closed straight away. A frame that does not fit into a
+// client's send buffer is dropped and counted, where the firmware would
+// stall the whole loop on a blocking write. Prints counters on exit
+// (SIGINT, SIGTERM or after -t seconds).
+
+#include <CarCore.h>
+
+#include "HostBindings.h"
+#include "HostWebSocket.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+constexpr uint32_t LOOP_PERIOD_MS = 10;
+constexpr uint8_t MAX_CLIENTS = 5;        // WEBSOCKETS_SERVER_CLIENT_MAX on ESP8266
+constexpr size_t SEND_BUFFER = 2920;      // lwIP TCP_SND_BUF, two segments
+constexpr size_t RECEIVE_BUFFER = 2048;
+constexpr size_t HANDSHAKE_MAX = 1024;
+
+struct Slot {
+  int fd = -1;
+  bool upgraded = false;
+  uint8_t in[RECEIVE_BUFFER];
+  size_t inLength = 0;
+  uint8_t out[SEND_BUFFER];
+  size_t outLength = 0;
+};
+
+struct Stats {
+  uint32_t connects = 0;
+  uint32_t rejected = 0;
+  uint32_t disconnects = 0;
+  uint64_t framesIn = 0;
+  uint64_t framesOut = 0;
+  uint64_t bytesOut = 0;
+  uint64_t dropped = 0;
+  uint64_t loops = 0;
+  uint64_t lateLoops = 0;
+};
+
+Slot slots[MAX_CLIENTS];
+uint8_t maxClients = MAX_CLIENTS;
+Stats stats;
+HostHal hal;
+volatile sig_atomic_t stopRequested = 0;
+
+void flushSlot(Slot& slot) {
+  while (slot.outLength > 0) {
+    ssize_t n = send(slot.fd, slot.out, slot.outLength, MSG_NOSIGNAL);
+    if (n <= 0) return;
+    memmove(slot.out, slot.out + n, slot.outLength - n);
+    slot.outLength -= n;
+  }
+}
+
+bool queueBytes(Slot& slot, const void* data, size_t length) {
+  if (slot.outLength + length > SEND_BUFFER) return false;
+  memcpy(slot.out + slot.outLength, data, length);
+  slot.outLength += length;
+  flushSlot(slot);
+  return true;
+}
+
+void queueFrame(uint8_t num, uint8_t opcode, const char* payload, size_t length) {
+  Slot& slot = slots[num];
+  if (slot.fd < 0 || !slot.upgraded) return;
+
+  uint8_t frame[WS_MAX_HEADER + WS_MAX_PAYLOAD];
+  if (length > WS_MAX_PAYLOAD) length = WS_MAX_PAYLOAD;
+  size_t size = wsEncodeFrame(opcode, payload, length, 0, false, frame);
+
+  if (queueBytes(slot, frame, size)) {
+    stats.framesOut++;
+    stats.bytesOut += size;
+  } else {
+    stats.dropped++;
+  }
+}
+
+class SocketLink : public CarLink {
+ public:
+  void send(uint8_t client, const char* text, size_t length) override {
+    if (client < maxClients) queueFrame(client, WS_OP_TEXT, text, length);
+  }
+
+  void broadcast(const char* text, size_t length) override {
+    for (uint8_t i = 0; i < maxClients; i++) queueFrame(i, WS_OP_TEXT, text, length);
+  }
+
+  uint8_t clientCount() override {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < maxClients; i++) count += slots[i].upgraded;
+    return count;
+  }
+};
+
+SocketLink socketLink;
+Car car(hal, socketLink);
+
+void closeSlot(uint8_t num) {
+  Slot& slot = slots[num];
+  bool wasUpgraded = slot.upgraded;
+  close(slot.fd);
+  slot.fd = -1;
+  slot.upgraded = false;
+  slot.inLength = 0;
+  slot.outLength = 0;
+  stats.disconnects++;
+  if (wasUpgraded) {
+    car.carLog("[%u] Disconnected!", num);
+    car.onClientEvent(num, CLIENT_DISCONNECTED, nullptr, 0);
+  }
+}
+
+void acceptClients(int listener) {
+  for (;;) {
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0) return;
+
+    uint8_t num = 0;
+    while (num < maxClients && slots[num].fd >= 0) num++;
+    if (num == maxClients) {
+      close(fd);
+      stats.rejected++;
+      continue;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    slots[num].fd = fd;
+    stats.connects++;
+  }
+}
+
+void handshake(uint8_t num) {
+  Slot& slot = slots[num];
+  std::string request((const char*)slot.in, slot.inLength);
+  size_t end = request.find("\r\n\r\n");
+  if (end == std::string::npos) {
+    if (slot.inLength >= HANDSHAKE_MAX) closeSlot(num);
+    return;
+  }
+
+  std::string key = httpHeader(request, "Sec-WebSocket-Key");
+  if (key.empty()) {
+    closeSlot(num);
+    return;
+  }
+
+  std::string response =
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Accept: " + wsAcceptKey(key) + "\r\n\r\n";
+  queueBytes(slot, response.data(), response.size());
+
+  size_t used = end + 4;
+  memmove(slot.in, slot.in + used, slot.inLength - used);
+  slot.inLength -= used;
+  slot.upgraded = true;
+  car.carLog("[%u] Connected", num);
+  car.onClientEvent(num, CLIENT_CONNECTED, nullptr, 0);
+}
+
+// One frame per client per pass, as WebSocketsServer::loop() does
+void handleFrame(uint8_t num) {
+  Slot& slot = slots[num];
+  WsFrame frame;
+  long size = wsDecodeFrame(slot.in, slot.inLength, frame);
+  if (size == 0) return;
+  if (size < 0) {
+    closeSlot(num);
+    return;
+  }
+
+  stats.framesIn++;
+  switch (frame.opcode) {
+    case WS_OP_TEXT:
+      car.onClientEvent(num, CLIENT_TEXT, frame.payload, frame.length);
+      break;
+    case WS_OP_BINARY:
+      car.onClientEvent(num, CLIENT_BINARY, frame.payload, frame.length);
+      break;
+    case WS_OP_PING:
+      queueFrame(num, WS_OP_PONG, (const char*)frame.payload, frame.length);
+      break;
+    case WS_OP_PONG:
+      break;
+    case WS_OP_CLOSE:
+      queueFrame(num, WS_OP_CLOSE, nullptr, 0);
+      closeSlot(num);
+      return;
+  }
+
+  memmove(slot.in, slot.in + size, slot.inLength - size);
+  slot.inLength -= size;
+}
+
+// webSocket.loop(): accept, read and handle one frame per client
+void serviceClients(int listener) {
+  acceptClients(listener);
+
+  for (uint8_t num = 0; num < maxClients; num++) {
+    Slot& slot = slots[num];
+    if (slot.fd < 0) continue;
+
+    flushSlot(slot);
+
+    if (slot.inLength < RECEIVE_BUFFER) {
+      ssize_t n = recv(slot.fd, slot.in + slot.inLength, RECEIVE_BUFFER - slot.inLength, 0);
+      if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        closeSlot(num);
+        continue;
+      }
+      if (n > 0) slot.inLength += n;
+    }
+
+    if (!slot.upgraded) handshake(num);
+    else handleFrame(num);
+  }
+}
+
+int listenOn(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  return fd;
+}
+
+void onSignal(int) { stopRequested = 1; }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint16_t port = 8081;
+  double seconds = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-p") && i + 1 < argc) port = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+      int m = atoi(argv[++i]);
+      maxClients = m < 1 ? 1 : (m > MAX_CLIENTS ? MAX_CLIENTS : m);
+    }
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc) seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-v")) hal.verbose = true;
+    else {
+      fprintf(stderr, "usage: %s [-p port] [-m max_clients] [-t seconds] [-v]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  int listener = listenOn(port);
+  if (listener < 0) {
+    fprintf(stderr, "cannot listen on 127.0.0.1:%u: %s\n", port, strerror(errno));
+    return 1;
+  }
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  car.begin();
+  printf("listening on ws://127.0.0.1:%u/ (%u clients max)\n", port, maxClients);
+  fflush(stdout);
+
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  auto elapsedMs = [&] {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  };
+
+  while (!stopRequested && (seconds <= 0 || elapsedMs() < seconds * 1000)) {
+    double passStart = elapsedMs();
+    hal.now = (uint32_t)passStart;
+
+    serviceClients(listener);
+    car.handleControlTick();
+    car.sendHeartbeat();
+
+    stats.loops++;
+    if (elapsedMs() - passStart > LOOP_PERIOD_MS) stats.lateLoops++;
+
+    // delay(10) at the end of loop()
+    std::this_thread::sleep_for(std::chrono::milliseconds(LOOP_PERIOD_MS));
+  }
+
+  for (uint8_t num = 0; num < maxClients; num++) {
+    if (slots[num].fd >= 0) closeSlot(num);
+  }
+  close(listener);
+
+  printf("connects=%u rejected=%u disconnects=%u\n", stats.connects, stats.rejected, stats.disconnects);
+  printf("frames_in=%llu frames_out=%llu bytes_out=%llu dropped_out=%llu\n",
+         (unsigned long long)stats.framesIn, (unsigned long long)stats.framesOut,
+         (unsigned long long)stats.bytesOut, (unsigned long long)stats.dropped);
+  printf("loops=%llu late_loops=%llu\n",
+         (unsigned long long)stats.loops, (unsigned long long)stats.lateLoops);
+  return 0;
+}
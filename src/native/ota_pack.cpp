@@ -0,0 +1,272 @@
+// Builds firmware update packages for POST /update and checks them.
+//
+//   ota_pack [-b base.bin] image.bin package.ota
+//   ota_pack -c [-b base.bin] [-o image.bin] [-s seed] package.ota
+//
+// image.bin is firmware.bin from the build, or firmware.bin.gz (gzip -9 -k
+// firmware.bin), which is sent as it is and inflated by the boot loader.
+// With -b, the package is a delta against base.bin, the image the car runs
+// now: runs of the new image found in the old one become copies, which
+// leaves little to send when only a few functions changed.
+//
+// -c applies a package the way the car does, through OtaReceiver, in
+// randomly sized pieces, and reports what it would install.
+
+#include <OtaUpdate.h>
+
+#include "HostBindings.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Old image blocks are indexed at this stride; a match is only worth a COPY
+// op (9 bytes) from MIN_MATCH bytes on
+constexpr size_t BLOCK_SIZE = 16;
+constexpr size_t MIN_MATCH = 24;
+constexpr size_t MAX_CANDIDATES = 8;
+constexpr size_t MAX_DATA = 0xFFFF;
+
+bool readFile(const char* path, std::vector<uint8_t>& data) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) data.insert(data.end(), buffer, buffer + n);
+  fclose(file);
+  return true;
+}
+
+bool writeFile(const char* path, const std::vector<uint8_t>& data) {
+  FILE* file = fopen(path, "wb");
+  if (!file || fwrite(data.data(), 1, data.size(), file) != data.size()) {
+    perror(path);
+    if (file) fclose(file);
+    return false;
+  }
+  return fclose(file) == 0;
+}
+
+void put16(std::vector<uint8_t>& out, uint16_t value) {
+  out.push_back(value & 0xFF);
+  out.push_back(value >> 8);
+}
+
+void put32(std::vector<uint8_t>& out, uint32_t value) {
+  for (int i = 0; i < 4; i++) out.push_back((uint8_t)(value >> (i * 8)));
+}
+
+uint64_t blockHash(const uint8_t* data) {
+  uint64_t hash = 1469598103934665603ULL;
+  for (size_t i = 0; i < BLOCK_SIZE; i++) hash = (hash ^ data[i]) * 1099511628211ULL;
+  return hash;
+}
+
+struct DeltaStats {
+  size_t copies = 0;
+  size_t copied = 0;
+  size_t literals = 0;
+  size_t literalBytes = 0;
+};
+
+class DeltaWriter {
+ public:
+  DeltaWriter(std::vector<uint8_t>& out, DeltaStats& stats) : out(out), stats(stats) {}
+
+  void literal(const uint8_t* data, size_t length) {
+    while (length > 0) {
+      size_t n = length < MAX_DATA ? length : MAX_DATA;
+      out.push_back(OTA_OP_DATA);
+      put16(out, (uint16_t)n);
+      out.insert(out.end(), data, data + n);
+      stats.literals++;
+      stats.literalBytes += n;
+      data += n;
+      length -= n;
+    }
+  }
+
+  void copy(size_t offset, size_t length) {
+    out.push_back(OTA_OP_COPY);
+    put32(out, (uint32_t)offset);
+    put32(out, (uint32_t)length);
+    stats.copies++;
+    stats.copied += length;
+  }
+
+ private:
+  std::vector<uint8_t>& out;
+  DeltaStats& stats;
+};
+
+// Greedy: at each position take the longest match among the indexed blocks
+// and the continuation of the previous copy, which is what unchanged code
+// after an edit looks like
+void makeDelta(const std::vector<uint8_t>& base, const std::vector<uint8_t>& image,
+               std::vector<uint8_t>& out, DeltaStats& stats) {
+  std::unordered_map<uint64_t, std::vector<uint32_t>> index;
+  for (size_t offset = 0; offset + BLOCK_SIZE <= base.size(); offset += BLOCK_SIZE) {
+    std::vector<uint32_t>& offsets = index[blockHash(base.data() + offset)];
+    if (offsets.size() < MAX_CANDIDATES) offsets.push_back((uint32_t)offset);
+  }
+
+  auto matchLength = [&](size_t from, size_t at) {
+    size_t n = 0;
+    while (from + n < base.size() && at + n < image.size() && base[from + n] == image[at + n]) n++;
+    return n;
+  };
+
+  DeltaWriter writer(out, stats);
+  size_t position = 0;
+  size_t literalStart = 0;
+  size_t nextBase = base.size();  // where the previous copy ended
+
+  while (position < image.size()) {
+    size_t bestOffset = 0;
+    size_t bestLength = 0;
+
+    if (nextBase < base.size()) {
+      bestOffset = nextBase;
+      bestLength = matchLength(nextBase, position);
+    }
+    if (bestLength < MIN_MATCH && position + BLOCK_SIZE <= image.size()) {
+      auto found = index.find(blockHash(image.data() + position));
+      if (found != index.end()) {
+        for (uint32_t offset : found->second) {
+          size_t n = matchLength(offset, position);
+          if (n > bestLength) {
+            bestOffset = offset;
+            bestLength = n;
+          }
+        }
+      }
+    }
+
+    if (bestLength < MIN_MATCH) {
+      position++;
+      continue;
+    }
+
+    writer.literal(image.data() + literalStart, position - literalStart);
+    writer.copy(bestOffset, bestLength);
+    position += bestLength;
+    literalStart = position;
+    nextBase = bestOffset + bestLength;
+  }
+  writer.literal(image.data() + literalStart, position - literalStart);
+}
+
+int pack(const char* basePath, const char* imagePath, const char* packagePath) {
+  std::vector<uint8_t> base, image;
+  if (!readFile(imagePath, image) || (basePath && !readFile(basePath, base))) return 1;
+  if (image.empty()) {
+    fprintf(stderr, "%s: empty image\n", imagePath);
+    return 1;
+  }
+
+  bool gzip = image.size() >= 2 && image[0] == 0x1F && image[1] == 0x8B;
+  if (gzip && basePath) {
+    fprintf(stderr, "a delta needs the uncompressed image\n");
+    return 1;
+  }
+  OtaFormat format = basePath ? OTA_DELTA : (gzip ? OTA_GZIP : OTA_IMAGE);
+
+  std::vector<uint8_t> package(OTA_MAGIC, OTA_MAGIC + sizeof(OTA_MAGIC));
+  package.push_back(OTA_VERSION);
+  package.push_back(format);
+  package.insert(package.end(), 3, 0);
+  put32(package, (uint32_t)image.size());
+  put32(package, (uint32_t)base.size());
+  Sha256 hash;
+  hash.update(image.data(), image.size());
+  package.resize(OTA_HEADER_SIZE);
+  hash.finish(package.data() + 16);
+
+  DeltaStats stats;
+  if (format == OTA_DELTA) makeDelta(base, image, package, stats);
+  else package.insert(package.end(), image.begin(), image.end());
+  if (!writeFile(packagePath, package)) return 1;
+
+  printf("format=%s image=%zu package=%zu (%.1f%%)\n",
+         format == OTA_DELTA ? "delta" : (gzip ? "gzip" : "image"),
+         image.size(), package.size(), 100.0 * package.size() / image.size());
+  if (format == OTA_DELTA) {
+    printf("base=%zu copies=%zu copied=%zu literals=%zu literal_bytes=%zu\n",
+           base.size(), stats.copies, stats.copied, stats.literals, stats.literalBytes);
+  }
+  return 0;
+}
+
+int check(const char* basePath, const char* outPath, unsigned seed, const char* packagePath) {
+  HostOtaTarget target;
+  std::vector<uint8_t> package;
+  if (!readFile(packagePath, package) || (basePath && !readFile(basePath, target.current))) return 1;
+
+  OtaReceiver receiver(target);
+  receiver.begin();
+
+  // Pieces of any size, like TCP delivers them; each write() may take less
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<size_t> pieceSize(1, 1460);
+  size_t offset = 0, calls = 0;
+  while (offset < package.size() && receiver.active()) {
+    size_t n = std::min(pieceSize(rng), package.size() - offset);
+    while (n > 0 && receiver.active()) {
+      size_t used = receiver.write(package.data() + offset, n);
+      offset += used;
+      n -= used;
+      calls++;
+    }
+  }
+  while (receiver.busy()) {
+    receiver.write(nullptr, 0);
+    calls++;
+  }
+
+  OtaError error = receiver.finish();
+  printf("result=%s format=%u image=%u written=%u target_writes=%u calls=%zu\n",
+         otaErrorName(error), (unsigned)receiver.format(), (unsigned)receiver.imageSize(),
+         (unsigned)receiver.written(), (unsigned)target.writes, calls);
+  if (error != OTA_OK) return 1;
+  if (outPath && !writeFile(outPath, target.image)) return 1;
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* basePath = nullptr;
+  const char* outPath = nullptr;
+  bool checking = false;
+  unsigned seed = 1;
+  const char* files[2] = {};
+  int fileCount = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-b") && i + 1 < argc) basePath = argv[++i];
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc) outPath = argv[++i];
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) seed = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-c")) checking = true;
+    else if (argv[i][0] != '-' && fileCount < 2) files[fileCount++] = argv[i];
+    else fileCount = -1;
+    if (fileCount < 0) break;
+  }
+
+  if (checking && fileCount == 1) return check(basePath, outPath, seed, files[0]);
+  if (!checking && fileCount == 2 && !outPath) return pack(basePath, files[0], files[1]);
+
+  fprintf(stderr,
+          "usage: %s [-b base.bin] image.bin package.ota\n"
+          "       %s -c [-b base.bin] [-o image.bin] [-s seed] package.ota\n",
+          argv[0], argv[0]);
+  return 2;
+}
@@ -0,0 +1,363 @@
+// Sends an update package to a car's POST /update, or stands in for the car
+// to receive one.
+//
+//   ota_upload [-h host] [-p port] package.ota
+//   ota_upload -l [-p port] [-b base.bin] [-o image.bin]
+//
+// The first form uploads like the page or curl would and reports the
+// answer and the throughput. With -l it listens on 127.0.0.1 for a single
+// upload and applies it the way the firmware does: the body goes into a
+// queue of the firmware's size, read only while there is room, so TCP flow
+// control holds the sender back, and each 10 ms loop pass feeds a few chunks
+// to OtaReceiver. As on the car, a body that is not application/octet-stream
+// is read and dropped, then refused, and a package that fails or a sender
+// that stalls is answered at once and the rest left unread. base.bin plays
+// the running image for deltas, image.bin receives what would be installed.
+// Throughout, a controller keeps sending "forward" to the car, and every
+// pass the motors turned is counted; with the motors locked for the update
+// that should stay at zero.
+
+#include <CarCore.h>
+#include <OtaUpdate.h>
+
+#include "HostBindings.h"
+#include "HostWebSocket.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t LOOP_PERIOD_MS = 10;
+constexpr size_t OTA_QUEUE_SIZE = 8192;      // as in src/main.cpp
+constexpr uint8_t OTA_CHUNKS_PER_LOOP = 4;
+constexpr uint32_t OTA_STALL_TIMEOUT_MS = 5000;
+constexpr int RECEIVE_WINDOW = 5840;         // lwIP TCP_WND, four segments
+constexpr size_t HEADER_MAX = 1024;
+
+using Clock = std::chrono::steady_clock;
+
+double msSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+bool readFile(const char* path, std::vector<uint8_t>& data) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) data.insert(data.end(), buffer, buffer + n);
+  fclose(file);
+  return true;
+}
+
+bool sendAll(int fd, const void* data, size_t length) {
+  const uint8_t* p = (const uint8_t*)data;
+  while (length > 0) {
+    ssize_t n = send(fd, p, length, MSG_NOSIGNAL);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    if (n <= 0) return false;
+    p += n;
+    length -= n;
+  }
+  return true;
+}
+
+// ===== Client =====
+int upload(const char* host, uint16_t port, const char* packagePath) {
+  std::vector<uint8_t> package;
+  if (!readFile(packagePath, package)) return 1;
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+    fprintf(stderr, "%s: not an IPv4 address\n", host);
+    return 2;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    fprintf(stderr, "cannot connect to %s:%u: %s\n", host, port, strerror(errno));
+    close(fd);
+    return 1;
+  }
+
+  char head[256];
+  int headLength = snprintf(head, sizeof(head),
+                            "POST /update HTTP/1.1\r\n"
+                            "Host: %s\r\n"
+                            "Content-Type: application/octet-stream\r\n"
+                            "Content-Length: %zu\r\n"
+                            "Connection: close\r\n\r\n",
+                            host, package.size());
+
+  auto start = Clock::now();
+  bool sent = sendAll(fd, head, headLength) && sendAll(fd, package.data(), package.size());
+  double sentMs = msSince(start);
+
+  std::string response;
+  char buffer[512];
+  ssize_t n;
+  while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) response.append(buffer, n);
+  double totalMs = msSince(start);
+  close(fd);
+
+  size_t body = response.find("\r\n\r\n");
+  std::string status = response.substr(0, response.find("\r\n"));
+  printf("status=\"%s\" answer=\"%s\"\n", status.c_str(),
+         body == std::string::npos ? "" : response.c_str() + body + 4);
+  printf("bytes=%zu sent=%s send_ms=%.0f total_ms=%.0f throughput_kib_s=%.1f\n",
+         package.size(), sent ? "all" : "partial", sentMs, totalMs,
+         package.size() / 1024.0 / (totalMs / 1000));
+  return status.find(" 200 ") != std::string::npos ? 0 : 1;
+}
+
+// ===== Stand-in Car =====
+struct StandIn {
+  HostHal hal;
+  HostLink link;
+  Car car{hal, link};
+  HostOtaTarget target;
+  OtaReceiver receiver{target};
+
+  uint8_t queue[OTA_QUEUE_SIZE];
+  size_t head = 0;
+  size_t fill = 0;
+
+  void enqueue(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) queue[(head + fill + i) % OTA_QUEUE_SIZE] = data[i];
+    fill += length;
+  }
+
+  // Mirrors serviceOta() in src/main.cpp
+  void service() {
+    for (uint8_t i = 0; i < OTA_CHUNKS_PER_LOOP && receiver.active(); i++) {
+      size_t run = std::min(fill, OTA_QUEUE_SIZE - head);
+      if (run == 0 && !receiver.busy()) break;
+      size_t used = receiver.write(queue + head, run);
+      head = (head + used) % OTA_QUEUE_SIZE;
+      fill -= used;
+    }
+  }
+
+  // The controller holding "forward", as the page repeats it; returns
+  // whether the motors turn
+  bool drive() {
+    car.dispatchText(0, "forward", 7);
+    car.handleControlTick();
+    return hal.pins[ENA] != 0 || hal.pins[ENB] != 0;
+  }
+};
+
+int listenOn(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  // Accepted sockets inherit it, which keeps the window near the car's
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &RECEIVE_WINDOW, sizeof(RECEIVE_WINDOW));
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void respond(int fd, int status, const char* reason, const char* text) {
+  char response[256];
+  int n = snprintf(response, sizeof(response),
+                   "HTTP/1.1 %d %s\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n"
+                   "Connection: close\r\n\r\n%s",
+                   status, reason, strlen(text), text);
+  sendAll(fd, response, n);
+}
+
+int standIn(uint16_t port, const char* basePath, const char* outPath) {
+  static StandIn car;
+  if (basePath && !readFile(basePath, car.target.current)) return 1;
+
+  int listener = listenOn(port);
+  if (listener < 0) {
+    fprintf(stderr, "cannot listen on 127.0.0.1:%u: %s\n", port, strerror(errno));
+    return 1;
+  }
+  printf("listening on http://127.0.0.1:%u/update\n", port);
+  fflush(stdout);
+
+  int fd = accept(listener, nullptr, nullptr);
+  close(listener);
+  if (fd < 0) return 1;
+
+  // Request head
+  std::string request;
+  size_t headEnd;
+  char buffer[OTA_QUEUE_SIZE];
+  while ((headEnd = request.find("\r\n\r\n")) == std::string::npos) {
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n <= 0 || request.size() > HEADER_MAX) {
+      close(fd);
+      return 1;
+    }
+    request.append(buffer, n);
+  }
+  if (request.compare(0, 13, "POST /update ") != 0) {
+    respond(fd, 404, "Not Found", "");
+    close(fd);
+    return 1;
+  }
+  size_t contentLength = strtoul(httpHeader(request, "Content-Length").c_str(), nullptr, 10);
+
+  // The car's refusal handler lets the server drop the body, then answers
+  if (httpHeader(request, "Content-Type") != "application/octet-stream") {
+    auto start = Clock::now();
+    size_t bodyReceived = request.size() - headEnd - 4;
+    ssize_t n = 1;
+    while (bodyReceived < contentLength &&
+           (n = recv(fd, buffer, std::min(sizeof(buffer), contentLength - bodyReceived), 0)) > 0) {
+      bodyReceived += n;
+    }
+    if (n > 0) respond(fd, 415, "Unsupported Media Type", "error:type");
+    close(fd);
+    printf("result=type received=%zu elapsed_ms=%.0f\n", bodyReceived, msSince(start));
+    return 1;
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+
+  car.car.begin();
+  bool ranBefore = car.drive();
+
+  auto start = Clock::now();
+  car.car.lockMotors(true);
+  car.receiver.begin();
+  size_t bodyReceived = request.size() - headEnd - 4;
+  car.enqueue((const uint8_t*)request.data() + headEnd + 4, bodyReceived);
+
+  bool disconnected = false, stalled = false;
+  uint32_t lastDataMs = 0;
+  uint32_t passes = 0, turningPasses = 0;
+  for (;;) {
+    car.hal.now = (uint32_t)msSince(start);
+
+    // The TCP callbacks: only what fits in the queue is taken off the socket
+    size_t room = OTA_QUEUE_SIZE - car.fill;
+    if (room > 0 && bodyReceived < contentLength) {
+      ssize_t n = recv(fd, buffer, std::min(room, contentLength - bodyReceived), 0);
+      if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        disconnected = true;
+        break;
+      }
+      if (n > 0) {
+        car.enqueue((const uint8_t*)buffer, n);
+        bodyReceived += n;
+        lastDataMs = car.hal.now;
+      }
+    }
+
+    car.service();
+    passes++;
+    if (car.drive()) turningPasses++;
+    // A failed package is answered without reading the rest
+    bool idle = car.fill == 0 && !car.receiver.busy();
+    if (!car.receiver.active() || (idle && bodyReceived == contentLength)) break;
+    if (idle && car.hal.now - lastDataMs >= OTA_STALL_TIMEOUT_MS) {
+      stalled = true;
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(LOOP_PERIOD_MS));
+  }
+
+  OtaError error;
+  if (disconnected) {
+    car.receiver.abort();
+    error = car.receiver.error();
+  } else if (stalled) {
+    car.receiver.abort();
+    error = car.receiver.error();
+    respond(fd, 408, "Request Timeout", "error:timeout");
+  } else {
+    error = car.receiver.finish();
+    char text[32];
+    if (error == OTA_OK) snprintf(text, sizeof(text), "ok:%u", (unsigned)car.receiver.written());
+    else snprintf(text, sizeof(text), "error:%s", otaErrorName(error));
+    respond(fd, error == OTA_OK ? 200 : 400, error == OTA_OK ? "OK" : "Bad Request", text);
+  }
+  close(fd);
+  double elapsedMs = msSince(start);
+
+  // Only a failed update gives the car back; a good one restarts it
+  if (error != OTA_OK) car.car.lockMotors(false);
+  bool runsAfter = car.drive();
+
+  printf("result=%s received=%zu image=%u written=%u elapsed_ms=%.0f throughput_kib_s=%.1f\n",
+         otaErrorName(error), bodyReceived, (unsigned)car.receiver.imageSize(),
+         (unsigned)car.receiver.written(), elapsedMs, bodyReceived / 1024.0 / (elapsedMs / 1000));
+  printf("passes=%u motors_turning_during_update=%u ran_before=%s runs_after=%s\n",
+         (unsigned)passes, (unsigned)turningPasses,
+         ranBefore ? "yes" : "no", runsAfter ? "yes" : "no");
+
+  if (error != OTA_OK) return 1;
+  if (outPath) {
+    FILE* file = fopen(outPath, "wb");
+    if (!file || fwrite(car.target.image.data(), 1, car.target.image.size(), file) != car.target.image.size()) {
+      perror(outPath);
+      if (file) fclose(file);
+      return 1;
+    }
+    fclose(file);
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* host = "192.168.10.1";
+  uint16_t port = 0;
+  bool local = false;
+  const char* basePath = nullptr;
+  const char* outPath = nullptr;
+  const char* packagePath = nullptr;
+  bool usage = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-h") && i + 1 < argc) host = argv[++i];
+    else if (!strcmp(argv[i], "-p") && i + 1 < argc) port = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-l")) local = true;
+    else if (!strcmp(argv[i], "-b") && i + 1 < argc) basePath = argv[++i];
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc) outPath = argv[++i];
+    else if (argv[i][0] != '-' && !packagePath) packagePath = argv[i];
+    else usage = true;
+  }
+
+  if (!usage && local && !packagePath) return standIn(port ? port : 8080, basePath, outPath);
+  if (!usage && !local && packagePath && !basePath && !outPath) return upload(host, port ? port : 80, packagePath);
+
+  fprintf(stderr,
+          "usage: %s [-h host] [-p port] package.ota\n"
+          "       %s -l [-p port] [-b base.bin] [-o image.bin]\n",
+          argv[0], argv[0]);
+  return 2;
+}
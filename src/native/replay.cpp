@@ -0,0 +1,256 @@
+// Replays a command log downloaded from /log through the same dispatch path
+// the car uses, on a virtual clock and as fast as the host allows.
+//
+//   replay [-d] [-r repeat] [-c config.txt] [-v] rec.bin
+//
+// -d prints every record instead of replaying. Otherwise each command is
+// dispatched at its recorded time and the resulting state is checked
+// against the recorded state delta. Exits non-zero on any mismatch.
+//
+// The car boots with the config saved in its flash, which the log does not
+// hold. -c takes that config as the "config:get" reply (key=value pairs,
+// comma separated, the "config:" prefix optional); without it the defaults
+// are used. Like the car, replay loads it at every boot, and a recorded
+// "config:save" changes what later boots load.
+
+#include <CarCore.h>
+
+#include "HostBindings.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+// loop() runs about every 10 ms on the car
+constexpr uint32_t LOOP_PERIOD_MS = 10;
+constexpr int MAX_REPORTED_MISMATCHES = 10;
+
+// The horn times out on the control tick, so whether it is still sounding
+// when a command lands depends on sub-tick timing the log does not keep.
+constexpr uint8_t VERIFIED_FLAGS = (uint8_t)~REC_FLAG_HORN;
+
+const char* sourceName(uint8_t source) {
+  switch (source & ~REC_TRUNCATED) {
+    case REC_TEXT: return "text";
+    case REC_BINARY: return "binary";
+    case REC_IR: return "ir";
+  }
+  return "?";
+}
+
+void printRecord(const LogRecord& rec) {
+  printf("%10u ms  %-6s client %u  ", (unsigned)rec.timeMs, sourceName(rec.source), rec.client);
+  if ((rec.source & ~REC_TRUNCATED) == REC_TEXT) {
+    printf("\"%.*s\"", (int)rec.length, (const char*)rec.payload);
+  } else if ((rec.source & ~REC_TRUNCATED) == REC_IR && rec.length == 4) {
+    uint32_t code = rec.payload[0] | (rec.payload[1] << 8) | (rec.payload[2] << 16) |
+                    ((uint32_t)rec.payload[3] << 24);
+    printf("0x%06X", (unsigned)code);
+  } else {
+    printf("%u bytes", rec.length);
+  }
+  if (rec.changed & REC_FIELD_DIRECTION) printf("  direction=%s", directionName((Direction)rec.state.direction));
+  if (rec.changed & REC_FIELD_PWM_SPEED) printf("  pwm=%u", rec.state.pwmSpeed);
+  if (rec.changed & REC_FIELD_TURN_SPEED) printf("  turn=%u", rec.state.turnSpeed);
+  if (rec.changed & REC_FIELD_FLAGS) printf("  flags=0x%02X", rec.state.flags);
+  printf("\n");
+}
+
+RecordedState expectedState(const LogRecord& rec, const RecordedState& before) {
+  RecordedState expected = before;
+  if (rec.changed & REC_FIELD_DIRECTION) expected.direction = rec.state.direction;
+  if (rec.changed & REC_FIELD_PWM_SPEED) expected.pwmSpeed = rec.state.pwmSpeed;
+  if (rec.changed & REC_FIELD_TURN_SPEED) expected.turnSpeed = rec.state.turnSpeed;
+  if (rec.changed & REC_FIELD_FLAGS) expected.flags = rec.state.flags;
+  return expected;
+}
+
+bool sameState(const RecordedState& a, const RecordedState& b) {
+  return a.direction == b.direction && a.pwmSpeed == b.pwmSpeed &&
+         a.turnSpeed == b.turnSpeed && ((a.flags ^ b.flags) & VERIFIED_FLAGS) == 0;
+}
+
+void dispatch(Car& car, const LogRecord& rec) {
+  switch (rec.source) {
+    case REC_TEXT:
+      car.dispatchText(rec.client, (const char*)rec.payload, rec.length);
+      break;
+    case REC_BINARY:
+      car.dispatchBinary(rec.client, rec.payload, rec.length);
+      break;
+    case REC_IR:
+      car.dispatchIR(rec.payload[0] | (rec.payload[1] << 8) | (rec.payload[2] << 16) |
+                     ((uint32_t)rec.payload[3] << 24));
+      break;
+  }
+}
+
+// Parses a "config:get" reply; strings cannot contain ',', as on the car
+bool parseConfig(const std::string& text, CarConfig& config) {
+  size_t start = text.compare(0, 7, "config:") == 0 ? 7 : 0;
+  while (start < text.size()) {
+    size_t end = text.find(',', start);
+    if (end == std::string::npos) end = text.size();
+    std::string pair = text.substr(start, end - start);
+    while (!pair.empty() && (pair.back() == '\n' || pair.back() == '\r')) pair.pop_back();
+    if (!pair.empty()) {
+      ConfigError error = setConfigValue(config, pair.data(), pair.size());
+      if (error != CONFIG_OK) {
+        fprintf(stderr, "config: %s: %s\n", configErrorName(error), pair.c_str());
+        return false;
+      }
+    }
+    start = end + 1;
+  }
+  return true;
+}
+
+// Power-on: millis() restarts and the config comes from flash
+void boot(Car& car, HostHal& hal, HostConfigStore& store) {
+  hal.now = 0;
+  car.config = CarConfig();
+  loadConfig(store, car.config);
+  car.begin();
+}
+
+// Runs the whole log once, starting from `flash` as the saved config.
+// Returns the number of state mismatches.
+int replay(const std::vector<LogRecord>& records, Car& car, HostHal& hal,
+           HostConfigStore& store, const uint8_t* flash, bool report) {
+  int mismatches = 0;
+  uint32_t previous = 0;
+
+  memcpy(store.block, flash, CONFIG_BLOCK_SIZE);
+  boot(car, hal, store);
+
+  for (const LogRecord& rec : records) {
+    // millis() went backwards: the car rebooted
+    if (rec.timeMs < previous) boot(car, hal, store);
+    previous = rec.timeMs;
+
+    while (hal.now + LOOP_PERIOD_MS <= rec.timeMs) {
+      hal.now += LOOP_PERIOD_MS;
+      car.handleControlTick();
+      car.sendHeartbeat();
+    }
+    hal.now = rec.timeMs;
+
+    if (rec.source & REC_TRUNCATED) continue;
+    if (rec.source == REC_IR && rec.length != 4) continue;
+
+    RecordedState before = car.recordedState();
+    dispatch(car, rec);
+    RecordedState after = car.recordedState();
+    RecordedState expected = expectedState(rec, before);
+
+    if (!sameState(after, expected)) {
+      if (report && mismatches < MAX_REPORTED_MISMATCHES) {
+        printf("mismatch: ");
+        printRecord(rec);
+        printf("    replayed direction=%s pwm=%u turn=%u flags=0x%02X\n",
+               directionName((Direction)after.direction), after.pwmSpeed,
+               after.turnSpeed, after.flags);
+      }
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* path = nullptr;
+  const char* configPath = nullptr;
+  bool dump = false;
+  long repeat = 1;
+  HostHal hal;
+  HostLink link;
+  link.clients = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-d")) dump = true;
+    else if (!strcmp(argv[i], "-v")) hal.verbose = true;
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc) repeat = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-c") && i + 1 < argc) configPath = argv[++i];
+    else path = argv[i];
+  }
+  if (!path || repeat < 1) {
+    fprintf(stderr, "usage: %s [-d] [-r repeat] [-c config.txt] [-v] rec.bin\n", argv[0]);
+    return 2;
+  }
+
+  std::ifstream file(path, std::ios::binary);
+  std::vector<uint8_t> log((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (log.size() < sizeof(RECORD_LOG_HEADER) ||
+      memcmp(log.data(), RECORD_LOG_HEADER, sizeof(RECORD_LOG_HEADER)) != 0) {
+    fprintf(stderr, "%s: not a command log\n", path);
+    return 2;
+  }
+
+  std::vector<LogRecord> records;
+  size_t offset = sizeof(RECORD_LOG_HEADER);
+  while (offset < log.size()) {
+    LogRecord rec;
+    size_t size = readRecord(log.data() + offset, log.size() - offset, rec);
+    if (size == 0) {
+      fprintf(stderr, "truncated record at byte %zu, ignoring the rest\n", offset);
+      break;
+    }
+    records.push_back(rec);
+    offset += size;
+  }
+
+  if (dump) {
+    for (const LogRecord& rec : records) printRecord(rec);
+    return 0;
+  }
+  if (records.empty()) {
+    printf("no records\n");
+    return 0;
+  }
+
+  // The saved config every run starts from
+  uint8_t flash[CONFIG_BLOCK_SIZE];
+  memset(flash, 0xFF, sizeof(flash));
+  if (configPath) {
+    std::ifstream configFile(configPath);
+    std::string text((std::istreambuf_iterator<char>(configFile)), std::istreambuf_iterator<char>());
+    CarConfig config;
+    if (!configFile || !parseConfig(text, config)) {
+      fprintf(stderr, "%s: not a config:get reply\n", configPath);
+      return 2;
+    }
+    encodeConfig(config, flash);
+  }
+
+  HostConfigStore store;
+  Car car(hal, link, nullptr, &store);
+
+  int mismatches = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (long r = 0; r < repeat; r++) {
+    mismatches = replay(records, car, hal, store, flash, r == 0);
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double wallMs = std::chrono::duration<double, std::milli>(end - start).count();
+  // Simulated time covered, summed over reboots
+  double spanMs = 0;
+  for (size_t i = 0; i < records.size(); i++) {
+    if (i + 1 == records.size() || records[i + 1].timeMs < records[i].timeMs) spanMs += records[i].timeMs;
+  }
+  spanMs *= repeat;
+  double recordsTotal = (double)records.size() * repeat;
+  printf("records=%zu repeat=%ld mismatches=%d\n", records.size(), repeat, mismatches);
+  printf("wall_ms=%.3f ns_per_record=%.1f speedup=%.0fx\n",
+         wallMs, wallMs * 1e6 / recordsTotal, wallMs > 0 ? spanMs / wallMs : 0.0);
+  return mismatches ? 1 : 0;
+}
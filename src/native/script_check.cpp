@@ -0,0 +1,212 @@
+// Host-side assembler and validator for motion scripts.
+//
+//   script_check [-t tick_ms] [-o out.bin] script.ms|script.bin
+//
+// Text scripts are assembled first. The script is then validated with the
+// same MotionScript::load() the car uses and dry-run on the control tick,
+// printing every output change with its time stamp.
+
+#include <MotionScript.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t MAX_SIMULATED_MS = 60UL * 1000UL;
+
+struct LightName {
+  const char* name;
+  uint8_t mask;
+};
+
+constexpr LightName LIGHT_NAMES[] = {
+  { "off", 0 },
+  { "headlight", SCRIPT_LIGHT_HEADLIGHT },
+  { "brakelight", SCRIPT_LIGHT_BRAKELIGHT },
+  { "left", SCRIPT_LIGHT_LEFT },
+  { "right", SCRIPT_LIGHT_RIGHT },
+  { "hazard", SCRIPT_LIGHT_HAZARD },
+};
+
+bool parseInt(const std::string& token, long min, long max, long& out) {
+  char* end = nullptr;
+  out = strtol(token.c_str(), &end, 0);
+  return !token.empty() && *end == '\0' && out >= min && out <= max;
+}
+
+bool parseLights(const std::string& token, uint8_t& mask) {
+  mask = 0;
+  std::stringstream parts(token);
+  std::string part;
+  while (std::getline(parts, part, '+')) {
+    bool found = false;
+    for (const LightName& light : LIGHT_NAMES) {
+      if (part == light.name) {
+        mask |= light.mask;
+        found = true;
+      }
+    }
+    if (!found) return false;
+  }
+  return true;
+}
+
+void put16(std::vector<uint8_t>& out, long value) {
+  out.push_back(value & 0xFF);
+  out.push_back((value >> 8) & 0xFF);
+}
+
+// One instruction per line, '#' starts a comment:
+//   drive <left> <right> <ms> | wait <ms> | lights <name>[+<name>...]
+//   horn beep|chirp | loop <count>|forever | next | end
+bool assemble(std::istream& in, std::vector<uint8_t>& out) {
+  out = { SCRIPT_MAGIC0, SCRIPT_MAGIC1, SCRIPT_VERSION };
+
+  std::string line;
+  int lineNo = 0;
+  while (std::getline(in, line)) {
+    lineNo++;
+    line = line.substr(0, line.find('#'));
+
+    std::stringstream tokens(line);
+    std::vector<std::string> args;
+    std::string op, arg;
+    if (!(tokens >> op)) continue;
+    while (tokens >> arg) args.push_back(arg);
+
+    long a = 0, b = 0, c = 0;
+    uint8_t mask = 0;
+    bool ok = true;
+
+    if (op == "drive" && args.size() == 3) {
+      ok = parseInt(args[0], -100, 100, a) && parseInt(args[1], -100, 100, b) &&
+           parseInt(args[2], 0, 0xFFFF, c);
+      out.push_back(OP_DRIVE);
+      out.push_back((uint8_t)(int8_t)a);
+      out.push_back((uint8_t)(int8_t)b);
+      put16(out, c);
+    } else if (op == "wait" && args.size() == 1) {
+      ok = parseInt(args[0], 0, 0xFFFF, a);
+      out.push_back(OP_WAIT);
+      put16(out, a);
+    } else if (op == "lights" && args.size() == 1) {
+      ok = parseLights(args[0], mask);
+      out.push_back(OP_LIGHTS);
+      out.push_back(mask);
+    } else if (op == "horn" && args.size() == 1) {
+      ok = args[0] == "beep" || args[0] == "chirp";
+      out.push_back(OP_HORN);
+      out.push_back(args[0] == "chirp" ? SCRIPT_HORN_CHIRP : SCRIPT_HORN_BEEP);
+    } else if (op == "loop" && args.size() == 1) {
+      ok = args[0] == "forever" || parseInt(args[0], 1, 255, a);
+      out.push_back(OP_LOOP);
+      out.push_back((uint8_t)a);
+    } else if (op == "next" && args.empty()) {
+      out.push_back(OP_NEXT);
+    } else if (op == "end" && args.empty()) {
+      out.push_back(OP_END);
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      fprintf(stderr, "line %d: cannot assemble '%s'\n", lineNo, line.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+class PrintTarget : public MotionTarget {
+ public:
+  explicit PrintTarget(const MotionScript& script) : script(script) {}
+
+  void drive(int8_t left, int8_t right) override {
+    printf("%8u ms  drive %4d %4d\n", (unsigned)script.elapsed(), left, right);
+  }
+  void lights(uint8_t mask) override {
+    printf("%8u ms  lights 0x%02x\n", (unsigned)script.elapsed(), mask);
+  }
+  void horn(uint8_t effect) override {
+    printf("%8u ms  horn %s\n", (unsigned)script.elapsed(),
+           effect == SCRIPT_HORN_CHIRP ? "chirp" : "beep");
+  }
+
+ private:
+  const MotionScript& script;
+};
+
+bool endsWith(const std::string& s, const char* suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string input, output;
+  long tickMs = 20;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-o") && i + 1 < argc) output = argv[++i];
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc) tickMs = atol(argv[++i]);
+    else input = argv[i];
+  }
+  if (input.empty() || tickMs <= 0 || tickMs > 1000) {
+    fprintf(stderr, "usage: %s [-t tick_ms] [-o out.bin] script.ms|script.bin\n", argv[0]);
+    return 2;
+  }
+
+  std::ifstream file(input, std::ios::binary);
+  if (!file) {
+    fprintf(stderr, "cannot open %s\n", input.c_str());
+    return 2;
+  }
+
+  std::vector<uint8_t> code;
+  if (endsWith(input, ".bin")) {
+    code.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  } else if (!assemble(file, code)) {
+    return 1;
+  }
+
+  MotionScript script;
+  size_t errorOffset = 0;
+  ScriptError error = script.load(code.data(), code.size(), &errorOffset);
+  if (error != SCRIPT_OK) {
+    fprintf(stderr, "invalid script: %s at byte %zu\n", scriptErrorName(error), errorOffset);
+    return 1;
+  }
+  printf("%zu bytes, valid\n", code.size());
+
+  PrintTarget target(script);
+  script.start(target);
+  while (script.running() && script.elapsed() < MAX_SIMULATED_MS) {
+    script.tick(tickMs);
+  }
+
+  if (script.running()) {
+    printf("still running after %u ms (endless loop)\n", (unsigned)MAX_SIMULATED_MS);
+  } else if (script.lastError() != SCRIPT_OK) {
+    fprintf(stderr, "script stopped: %s\n", scriptErrorName(script.lastError()));
+    return 1;
+  } else {
+    printf("finished after %u ms\n", (unsigned)script.elapsed());
+  }
+
+  if (!output.empty()) {
+    std::ofstream out(output, std::ios::binary);
+    out.write((const char*)code.data(), code.size());
+    if (!out) {
+      fprintf(stderr, "cannot write %s\n", output.c_str());
+      return 2;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,237 @@
+// Drives the car logic against the simulated plant and measures what the
+// motor sequences actually do.
+//
+//   sim              run every scenario once with the default plant
+//   sim -n 1000      sweep: randomized plants, percentiles per metric
+//   sim -n 1000 -c   sweep, one CSV line per run instead
+//   sim -s 42        seed for the sweep
+//   sim -e ...       fit wheel encoders, so the car runs closed-loop speed control
+//
+// Every command goes through dispatchText() and time advances in the 10 ms
+// steps loop() runs at, so the plant sees the same pin sequences as the car.
+
+#include <CarCore.h>
+#include <CarSim.h>
+
+#include "HostBindings.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t LOOP_PERIOD_MS = 10;
+constexpr double STOPPED_SPEED = 0.01;  // m/s
+constexpr double RAD_TO_DEG = 57.29577951308232;
+
+struct Metric {
+  const char* name;
+  const char* unit;
+};
+
+// One result slot per metric, in this order
+constexpr Metric METRICS[] = {
+  { "stop_ms", "ms" },        // stop command until the car stands still
+  { "stop_cm", "cm" },        // distance covered meanwhile
+  { "rise_ms", "ms" },        // forward from rest to 90 % of cruise speed
+  { "cruise_mps", "m/s" },    // forward speed after 2 s at 80 %
+  { "step_ms", "ms" },        // 30 % -> 100 % speed change to 90 % of the step
+  { "drift_deg", "deg" },     // heading error after 3 s straight
+  { "spin_dps", "deg/s" },    // yaw rate while turning in place
+  { "sag_v", "V" },           // lowest bus voltage seen
+};
+constexpr size_t METRIC_COUNT = sizeof(METRICS) / sizeof(METRICS[0]);
+
+uint64_t simulatedMs = 0;
+
+enum MetricIndex {
+  M_STOP_MS, M_STOP_CM, M_RISE_MS, M_CRUISE, M_STEP_MS, M_DRIFT, M_SPIN, M_SAG
+};
+
+class Scenario {
+ public:
+  explicit Scenario(const PlantParams& params) : sim(params) {
+    car.begin();
+  }
+
+  ~Scenario() { simulatedMs += sim.millis(); }
+
+  void command(const char* text) {
+    car.dispatchText(0, text, strlen(text));
+  }
+
+  void run(uint32_t ms) {
+    for (uint32_t t = 0; t < ms; t += LOOP_PERIOD_MS) step();
+  }
+
+  // Runs until `done` holds or `limitMs` passes. Returns the elapsed time.
+  template <typename Done>
+  uint32_t runUntil(Done done, uint32_t limitMs) {
+    uint32_t start = sim.millis();
+    while (!done() && sim.millis() - start < limitMs) step();
+    return sim.millis() - start;
+  }
+
+  double minVoltage = 1e9;
+  CarSim sim;
+
+ private:
+  void step() {
+    sim.advance(LOOP_PERIOD_MS);
+    car.handleControlTick();
+    minVoltage = std::min(minVoltage, sim.busVoltage());
+  }
+
+  HostLink link;
+  Car car{sim, link};
+};
+
+void runAll(const PlantParams& params, double* out) {
+  {
+    Scenario s(params);
+    s.command("speed:80");
+    s.command("forward");
+    s.run(2000);
+    out[M_CRUISE] = s.sim.speed();
+
+    double start = s.sim.distance;
+    s.command("stop");
+    out[M_STOP_MS] = s.runUntil([&] { return fabs(s.sim.speed()) < STOPPED_SPEED; }, 5000);
+    out[M_STOP_CM] = (s.sim.distance - start) * 100;
+    out[M_SAG] = s.minVoltage;
+  }
+  {
+    Scenario s(params);
+    s.command("speed:80");
+    s.command("forward");
+    const double target = 0.9 * out[M_CRUISE];
+    out[M_RISE_MS] = s.runUntil([&] { return s.sim.speed() >= target; }, 5000);
+  }
+  {
+    Scenario s(params);
+    s.command("speed:30");
+    s.command("forward");
+    s.run(2000);
+    double low = s.sim.speed();
+    s.command("speed:100");
+    s.run(2000);
+    double high = s.sim.speed();
+
+    Scenario again(params);
+    again.command("speed:30");
+    again.command("forward");
+    again.run(2000);
+    again.command("speed:100");
+    const double target = low + 0.9 * (high - low);
+    out[M_STEP_MS] = again.runUntil([&] { return again.sim.speed() >= target; }, 5000);
+  }
+  {
+    Scenario s(params);
+    s.command("forward");
+    s.run(3000);
+    out[M_DRIFT] = s.sim.heading * RAD_TO_DEG;
+  }
+  {
+    Scenario s(params);
+    s.command("left");
+    s.run(1500);
+    out[M_SPIN] = s.sim.yawRate() * RAD_TO_DEG;
+  }
+}
+
+PlantParams randomPlant(std::mt19937& rng, uint16_t encoderCpr) {
+  auto uniform = [&](double lo, double hi) {
+    return std::uniform_real_distribution<double>(lo, hi)(rng);
+  };
+
+  PlantParams p;
+  p.batteryVoltage = uniform(6.4, 8.4);
+  p.batteryResistance = uniform(0.2, 0.8);
+  p.motorTau = uniform(0.08, 0.18);
+  p.sideMismatch = uniform(-0.08, 0.08);
+  p.tractionLimit = uniform(0, 1) < 0.3 ? uniform(3, 8) : 0;
+  p.encoderCpr = encoderCpr;
+  return p;
+}
+
+double percentile(std::vector<double>& values, double q) {
+  size_t i = (size_t)std::min<double>(values.size() - 1, q * values.size());
+  std::nth_element(values.begin(), values.begin() + i, values.end());
+  return values[i];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  long runs = 0;
+  unsigned seed = 1;
+  bool csv = false;
+  uint16_t encoderCpr = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) runs = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) seed = strtoul(argv[++i], nullptr, 0);
+    else if (!strcmp(argv[i], "-c")) csv = true;
+    else if (!strcmp(argv[i], "-e")) encoderCpr = ENCODER_CPR;
+    else {
+      fprintf(stderr, "usage: %s [-n runs] [-s seed] [-c] [-e]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  double result[METRIC_COUNT];
+
+  if (runs <= 0) {
+    PlantParams plant;
+    plant.encoderCpr = encoderCpr;
+    runAll(plant, result);
+    for (size_t m = 0; m < METRIC_COUNT; m++) {
+      printf("%-12s %10.3f %s\n", METRICS[m].name, result[m], METRICS[m].unit);
+    }
+    return 0;
+  }
+
+  std::mt19937 rng(seed);
+  std::vector<double> samples[METRIC_COUNT];
+
+  if (csv) {
+    printf("run,battery_v,resistance,tau,mismatch,traction");
+    for (const Metric& metric : METRICS) printf(",%s", metric.name);
+    printf("\n");
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (long r = 0; r < runs; r++) {
+    PlantParams plant = randomPlant(rng, encoderCpr);
+    runAll(plant, result);
+
+    if (csv) {
+      printf("%ld,%.3f,%.3f,%.3f,%.3f,%.2f", r, plant.batteryVoltage, plant.batteryResistance,
+             plant.motorTau, plant.sideMismatch, plant.tractionLimit);
+      for (double value : result) printf(",%.4f", value);
+      printf("\n");
+    }
+    for (size_t m = 0; m < METRIC_COUNT; m++) samples[m].push_back(result[m]);
+  }
+  double wallMs = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count();
+
+  if (csv) return 0;
+
+  printf("%-12s %10s %10s %10s %10s\n", "metric", "p5", "p50", "p95", "unit");
+  for (size_t m = 0; m < METRIC_COUNT; m++) {
+    printf("%-12s %10.3f %10.3f %10.3f %10s\n", METRICS[m].name,
+           percentile(samples[m], 0.05), percentile(samples[m], 0.5),
+           percentile(samples[m], 0.95), METRICS[m].unit);
+  }
+
+  printf("runs=%ld simulated_s=%.0f wall_ms=%.0f speedup=%.0fx\n",
+         runs, simulatedMs / 1000.0, wallMs, simulatedMs / wallMs);
+  return 0;
+}